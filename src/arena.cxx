@@ -0,0 +1,72 @@
+#include "arena.hxx"
+#include <stdlib.h>
+#include <new>
+
+Arena::Arena(size_t blockSize_) :
+  blockSize(blockSize_),
+  allocations(0),
+  blockAllocations(0),
+  used(0),
+  current(0),
+  offset(0)
+{
+}
+
+Arena::~Arena()
+{
+  for (size_t i=0; i<blocks.size(); i++)
+    free(blocks[i].data);
+}
+
+void *Arena::alloc(size_t n, size_t align)
+{
+  allocations++;
+  for (;;)
+  {
+    if (current < blocks.size())
+    {
+      Block& b = blocks[current];
+      /* malloc() alignment is good enough for any block start */
+      size_t start = (offset + align - 1) & ~(align - 1);
+      if (start + n <= b.size)
+      {
+        offset = start + n;
+        used += n;
+        return b.data + start;
+      }
+      /* Move on to the next block, abandoning the rest of this one. After
+       * a reset() the next block is an old one that may be big enough. */
+      if (current + 1 < blocks.size())
+      {
+        current++;
+        offset = 0;
+        continue;
+      }
+    }
+
+    Block b;
+    b.size = n + align > blockSize ? n + align : blockSize;
+    b.data = (unsigned char*) malloc(b.size);
+    if (!b.data)
+      throw std::bad_alloc();
+    blockAllocations++;
+    blocks.push_back(b);
+    current = blocks.size() - 1;
+    offset = 0;
+  }
+}
+
+void Arena::reset()
+{
+  current = 0;
+  offset = 0;
+  used = 0;
+}
+
+size_t Arena::capacity() const
+{
+  size_t n = 0;
+  for (size_t i=0; i<blocks.size(); i++)
+    n += blocks[i].size;
+  return n;
+}
@@ -0,0 +1,52 @@
+#ifndef ARENA_HXX
+#define ARENA_HXX
+#include <stddef.h>
+#include <vector>
+
+/* A bump allocator for data that lives and dies together, such as a World's
+ * rafts and their tiles
+ *
+ * Memory comes from the system in blocks of blockSize bytes (or larger, for
+ * allocations that don't fit in one) and is handed out in order. Nothing is
+ * freed individually: reset() rewinds to the first block in O(1) time, and
+ * keeps every block around for the allocations that follow, so reloading a
+ * world of the same size goes back to the system for nothing.
+ *
+ * Objects placed in an arena must be destroyed by calling their destructors
+ * explicitly, never with delete.
+ */
+#define ARENA_BLOCKSIZE (1 << 20)
+
+struct Arena {
+  size_t blockSize;
+
+  /* alloc() calls, and blocks requested from the system, since construction */
+  unsigned long allocations;
+  unsigned long blockAllocations;
+  /* Bytes handed out since the last reset() */
+  size_t used;
+
+  Arena(size_t blockSize_=ARENA_BLOCKSIZE);
+  ~Arena();
+
+  void *alloc(size_t n, size_t align=16);
+
+  void reset();
+
+  /* Total size of the blocks held */
+  size_t capacity() const;
+
+private:
+  struct Block {
+    unsigned char *data;
+    size_t size;
+  };
+  std::vector<Block> blocks;
+  /* The block being allocated from, and how much of it is used */
+  size_t current;
+  size_t offset;
+
+  Arena(const Arena &);
+  Arena & operator=(const Arena &);
+};
+#endif
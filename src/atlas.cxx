@@ -0,0 +1,194 @@
+#include "log.hxx"
+#include "atlas.hxx"
+#include "timer.hxx"
+#include <SDL.h>
+#include <string.h>
+#include <sys/stat.h>
+using namespace std;
+
+static uint64_t alignUp(uint64_t n)
+{
+  return (n + ATLAS_ALIGN - 1) / ATLAS_ALIGN * ATLAS_ALIGN;
+}
+
+/* Number of mip levels down to 1x1 */
+static int countLevels(int width, int height)
+{
+  int levels = 1;
+  while ((width > 1 || height > 1) && levels < ATLAS_MAXLEVELS)
+  {
+    width = width > 1 ? width / 2 : 1;
+    height = height > 1 ? height / 2 : 1;
+    levels++;
+  }
+  return levels;
+}
+
+static int levelWidth(int width, int i)
+{
+  return width >> i ? width >> i : 1;
+}
+
+Atlas::Atlas() :
+  width(0),
+  height(0),
+  levels(0),
+  cached(false)
+{
+  memset(level, 0, sizeof(level));
+}
+
+Atlas *Atlas::load(string source, string cacheFile, int width, int height)
+{
+  double t0 = timerSeconds();
+
+  /* The header a fresh cache for the source would have */
+  struct stat st;
+  if (stat(source.c_str(), &st) != 0)
+  {
+    LOGW(LOG_RENDER, "Could not stat %s\n", source.c_str());
+    return NULL;
+  }
+  AtlasHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, ATLAS_MAGIC, sizeof(h.magic));
+  h.bom = ATLAS_BOM;
+  h.version = ATLAS_VERSION;
+  h.sourceSize = st.st_size;
+  h.sourceMtime = st.st_mtime;
+  h.width = width;
+  h.height = height;
+  h.levels = countLevels(width, height);
+  uint64_t offset = alignUp(sizeof(h));
+  for (uint32_t i=0; i<h.levels; i++)
+  {
+    h.offset[i] = offset;
+    offset = alignUp(offset + (uint64_t)levelWidth(width, i) * levelWidth(height, i) * 4);
+  }
+
+  Atlas *atlas = new Atlas;
+  atlas->width = width;
+  atlas->height = height;
+  atlas->levels = h.levels;
+
+  if (atlas->loadCache(cacheFile, h))
+  {
+    atlas->cached = true;
+    LOGI(LOG_RENDER, "tile atlas: loaded %s in %.1f ms\n", cacheFile.c_str(), (timerSeconds() - t0) * 1000);
+    return atlas;
+  }
+
+  if (!atlas->bake(source, h))
+  {
+    delete atlas;
+    return NULL;
+  }
+  if (!atlas->writeCache(cacheFile, h))
+    LOGW(LOG_RENDER, "Could not write %s\n", cacheFile.c_str());
+  LOGI(LOG_RENDER, "tile atlas: baked %s in %.1f ms\n", source.c_str(), (timerSeconds() - t0) * 1000);
+  return atlas;
+}
+
+bool Atlas::loadCache(string cacheFile, const AtlasHeader& expected)
+{
+  if (!file.open(cacheFile))
+    return false;
+
+  /* Everything but the level data must match; the offsets are implied by the
+   * dimensions, so this also checks that the file is long enough. */
+  const AtlasHeader *h = (const AtlasHeader*)file.data;
+  uint64_t end = alignUp(expected.offset[expected.levels - 1]
+      + (uint64_t)levelWidth(width, levels - 1) * levelWidth(height, levels - 1) * 4);
+  if (file.size < sizeof(AtlasHeader)
+  ||  memcmp(h, &expected, sizeof(AtlasHeader)) != 0
+  ||  file.size < end)
+  {
+    file.close();
+    return false;
+  }
+
+  for (int i=0; i<levels; i++)
+    level[i] = (const uint32_t*)(file.data + h->offset[i]);
+  return true;
+}
+
+bool Atlas::bake(string source, const AtlasHeader& h)
+{
+  SDL_Surface *surface = SDL_CreateRGBSurface(0, width, height, 32,
+  #if SDL_BYTEORDER == SDL_BIG_ENDIAN
+    0xff000000, 0x00ff0000, 0x0000ff00, 0x000000ff
+  #else
+    0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000
+  #endif
+  );
+  if (surface == NULL)
+  {
+    LOGE(LOG_RENDER, "error: SDL_CreateRGBSurface(): %s\n", SDL_GetError());
+    return false;
+  }
+
+  SDL_Surface *loaded = SDL_LoadBMP(source.c_str());
+  if (loaded == NULL)
+  {
+    LOGE(LOG_RENDER, "Could not load %s: %s\n", source.c_str(), SDL_GetError());
+    SDL_FreeSurface(surface);
+    return false;
+  }
+
+  /* Color keyed pixels aren't blitted, so stay transparent black */
+  SDL_SetColorKey(loaded, SDL_SRCCOLORKEY, SDL_MapRGB(loaded->format, 255, 0, 255));
+  SDL_BlitSurface(loaded, NULL, surface, NULL);
+  SDL_FreeSurface(loaded);
+
+  /* Lay the levels out in memory just as they are in the cache file */
+  uint64_t size = h.offset[levels - 1]
+      + (uint64_t)levelWidth(width, levels - 1) * levelWidth(height, levels - 1) * 4;
+  pixels.assign((size + 3) / 4, 0);
+  unsigned char *base = (unsigned char*)&pixels[0];
+  for (int i=0; i<levels; i++)
+    level[i] = (const uint32_t*)(base + h.offset[i]);
+
+  SDL_LockSurface(surface);
+  for (int y=0; y<height; y++)
+    memcpy(base + h.offset[0] + y * width * 4,
+           (unsigned char*)surface->pixels + y * surface->pitch, width * 4);
+  SDL_UnlockSurface(surface);
+  SDL_FreeSurface(surface);
+
+  /* Each level is a 2x2 box filter of the one above. Tiles are a power of two
+   * in size, so no level mixes texels from neighbouring tiles until a tile is
+   * smaller than a texel. */
+  for (int i=1; i<levels; i++)
+  {
+    int sw = levelWidth(width, i - 1), sh = levelWidth(height, i - 1);
+    int dw = levelWidth(width, i), dh = levelWidth(height, i);
+    const unsigned char *src = (const unsigned char*)level[i - 1];
+    unsigned char *dst = (unsigned char*)level[i];
+    for (int y=0; y<dh; y++)
+    for (int x=0; x<dw; x++)
+    {
+      int x0 = x * 2 % sw, x1 = (x * 2 + 1) % sw;
+      int y0 = y * 2 % sh, y1 = (y * 2 + 1) % sh;
+      for (int c=0; c<4; c++)
+        dst[(y * dw + x) * 4 + c] = (src[(y0 * sw + x0) * 4 + c] + src[(y0 * sw + x1) * 4 + c]
+                                   + src[(y1 * sw + x0) * 4 + c] + src[(y1 * sw + x1) * 4 + c] + 2) / 4;
+    }
+  }
+  return true;
+}
+
+bool Atlas::writeCache(string cacheFile, const AtlasHeader& h) const
+{
+  AtomicFile f;
+  f.open(cacheFile);
+  f.write(&h, sizeof(h));
+
+  /* The level data in memory already has the file's layout */
+  const unsigned char *base = (const unsigned char*)&pixels[0];
+  f.write(base + sizeof(h), pixels.size() * 4 - sizeof(h));
+
+  /* Pad out to a whole page so the last level can be mapped */
+  static const unsigned char zeros[ATLAS_ALIGN] = {0};
+  f.write(zeros, alignUp(f.written) - f.written);
+  return f.commit();
+}
@@ -0,0 +1,69 @@
+#ifndef ATLAS_HXX
+#define ATLAS_HXX
+#include "mapped-file.hxx"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/* Tile set atlases
+ *
+ * Loading a tile set from its BMP means decoding it, color keying it and
+ * converting it to RGBA on every startup. Instead the result, along with a
+ * full chain of mip levels, is baked into a cache file next to the source,
+ * stored exactly as glTexImage2D() wants it (RGBA, GL_UNSIGNED_BYTE). Later
+ * runs map the cache and upload straight from the mapping. The cache records
+ * the size and modification time of the source, and is rebaked whenever
+ * either changes.
+ */
+#define ATLAS_MAGIC "LD26ATLS"
+#define ATLAS_VERSION 1
+#define ATLAS_BOM 0x01020304
+#define ATLAS_ALIGN 4096
+#define ATLAS_MAXLEVELS 16
+
+struct AtlasHeader {
+  char magic[8];
+  uint32_t bom;
+  uint32_t version;
+  /* The source image this cache was baked from */
+  uint64_t sourceSize;
+  int64_t sourceMtime;
+  uint32_t width;
+  uint32_t height;
+  uint32_t levels;
+  uint32_t reserved;
+  /* Start of each mip level, from the start of the file */
+  uint64_t offset[ATLAS_MAXLEVELS];
+};
+
+struct Atlas {
+  /* Size of level 0, in texels */
+  int width;
+  int height;
+  int levels;
+  /* RGBA texels of each mip level; level i is (width>>i) x (height>>i) */
+  const uint32_t *level[ATLAS_MAXLEVELS];
+
+  /* True if this atlas was loaded from its cache rather than baked */
+  bool cached;
+
+  /* Load the atlas for source, a BMP whose 255,0,255 pixels are transparent,
+   * from cacheFile, baking the cache first if it is missing or stale. The
+   * atlas is width x height texels; the source is placed in its top left
+   * corner. Returns NULL if the source can't be loaded either. */
+  static Atlas *load(std::string source, std::string cacheFile, int width, int height);
+
+private:
+  /* Where the texels live: a mapped cache file, or memory if just baked */
+  MappedFile file;
+  std::vector<uint32_t> pixels;
+
+  Atlas();
+  bool bake(std::string source, const AtlasHeader& h);
+  bool loadCache(std::string cacheFile, const AtlasHeader& expected);
+  bool writeCache(std::string cacheFile, const AtlasHeader& h) const;
+
+  Atlas(const Atlas &);
+  Atlas & operator=(const Atlas &);
+};
+#endif
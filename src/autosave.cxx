@@ -0,0 +1,395 @@
+#include "console.hxx"
+#include "log.hxx"
+#include "autosave.hxx"
+#include "mapfile.hxx"
+#include "tile-raft.hxx"
+#include "rle.hxx"
+#include "timer.hxx"
+#include <SDL.h>
+#include <SDL_thread.h>
+#include <string.h>
+#include <map>
+using namespace std;
+
+double autosaveInterval = 60;
+string autosaveFilename = "data/maps/autosave.map";
+
+/* A chunk as snapshotted. id is 0 for a blank chunk. Changed chunks have
+ * their tiles copied into SaveJob :: tiles at offset copy; for the rest,
+ * copy is -1 and the saver already has their encoding. */
+struct SaveChunk {
+  unsigned long long id;
+  unsigned int revision;
+  long copy;
+};
+
+/* The tile block, in its map file, of a raft that has never been paged in.
+ * Such a raft can't have been edited, so it is saved from there as it is,
+ * without being read in. data is NULL for every other raft. */
+struct SourceBlock {
+  const unsigned char *data;
+  uint64_t size;
+  uint32_t encoding;
+  uint32_t checksum;
+};
+
+struct SaveJob {
+  string filename;
+  /* Size and position of each raft */
+  vector<MapFileRaft> table;
+  /* Raft i's chunks are chunks[firstChunk[i]] up to chunks[firstChunk[i+1]] */
+  vector<size_t> firstChunk;
+  vector<SaveChunk> chunks;
+  vector<unsigned char> tiles;
+  /* Indexed like table. The map files these point into stay mapped until
+   * the save is done; see autosaveWait(). */
+  vector<SourceBlock> sources;
+  /* When the snapshot was started, and how long it took */
+  double started;
+  double snapshotTime;
+};
+
+struct CachedChunk {
+  unsigned int revision;
+  /* The number of the last save that used this chunk */
+  unsigned long save;
+  vector<unsigned char> rle;
+};
+
+/* Belongs to the saver while a save is in flight, and to the main thread
+ * otherwise */
+static SaveJob job;
+static map<unsigned long long, CachedChunk> cache;
+static vector< vector<unsigned char> > blocks;
+
+/* Everything below is guarded by lock */
+static SDL_Thread *saver;
+static SDL_mutex *lock;
+static SDL_cond *wake;
+/* Signalled by the saver whenever it finishes a job */
+static SDL_cond *idle;
+static bool quit;
+/* Set by the main thread when it hands over a job, and cleared by the saver
+ * when it is done with it */
+static bool busy;
+/* Set by the saver when a save is done, and cleared once it's reported */
+static bool finished;
+
+/* Results of the last save */
+static bool lastOk;
+static uint64_t lastBytes;
+static double lastLatency;
+static double lastSnapshot;
+static unsigned long lastEncoded;
+static unsigned long lastChunks;
+static unsigned long saves;
+static unsigned long failures;
+
+/* Main thread only: when the next autosave is due, and the stamp() of the
+ * rafts as last saved and as being saved now */
+static double nextSave = 0;
+static unsigned long long savedStamp;
+static unsigned long long pendingStamp;
+
+/* Changes whenever any raft is edited, added or removed */
+static unsigned long long stamp(const vector<TileRaft*>& rafts)
+{
+  unsigned long long s = rafts.size() + 1;
+  for (size_t i=0; i<rafts.size(); i++)
+    s = s * 1000003 + rafts[i]->revision;
+  return s;
+}
+
+static void snapshot(const vector<TileRaft*>& rafts)
+{
+  job.started = timerSeconds();
+  job.filename = autosaveFilename;
+  job.table.resize(rafts.size());
+  job.firstChunk.clear();
+  job.chunks.clear();
+  job.tiles.clear();
+  job.sources.resize(rafts.size());
+
+  for (size_t i=0; i<rafts.size(); i++)
+  {
+    const TileRaft *raft = rafts[i];
+    MapFileRaft& r = job.table[i];
+    memset(&r, 0, sizeof(r));
+    r.width = raft->width;
+    r.height = raft->height;
+    r.xOff = raft->xOff;
+    r.yOff = raft->yOff;
+
+    job.firstChunk.push_back(job.chunks.size());
+    SourceBlock& src = job.sources[i];
+    memset(&src, 0, sizeof(src));
+    if (raft->source)
+    {
+      const MapFileRaft& from = raft->source->table[raft->sourceIndex];
+      src.data = raft->source->data + from.offset;
+      src.size = from.size;
+      src.encoding = from.encoding;
+      src.checksum = from.checksum;
+      continue;
+    }
+    for (size_t c=0; c<raft->chunks.size(); c++)
+    {
+      TileChunk *chunk = raft->chunks[c];
+      SaveChunk sc = { 0, 0, -1 };
+      if (chunk)
+      {
+        sc.id = chunk->id;
+        sc.revision = chunk->revision;
+        map<unsigned long long, CachedChunk>::iterator cached = cache.find(sc.id);
+        if (cached == cache.end() || cached->second.revision != sc.revision)
+        {
+          sc.copy = job.tiles.size();
+          job.tiles.insert(job.tiles.end(), chunk->tiles, chunk->tiles + CHUNKSIZE*CHUNKSIZE);
+        }
+      }
+      job.chunks.push_back(sc);
+    }
+  }
+  job.firstChunk.push_back(job.chunks.size());
+  job.snapshotTime = timerSeconds() - job.started;
+}
+
+/* RLE encode the tile block of a raft that was never paged in, unless it
+ * already is */
+static void encodeSource(const SourceBlock& src, const MapFileRaft& r, vector<unsigned char>& block)
+{
+  bool intact = mapChecksum(src.data, src.size) == src.checksum;
+  if (intact && src.encoding == MAPFILE_RLE)
+  {
+    block.assign(src.data, src.data + src.size);
+    return;
+  }
+
+  RleEncoder rle(block);
+  if (intact)
+    rle.put(src.data, src.size);
+  else
+  {
+    /* Paging it in would have left it blank, so save it that way */
+    size_t chunks = (size_t)((r.width + CHUNKSIZE - 1) / CHUNKSIZE)
+                          * ((r.height + CHUNKSIZE - 1) / CHUNKSIZE);
+    rle.putRun(0, chunks * CHUNKSIZE*CHUNKSIZE);
+  }
+  rle.finish();
+}
+
+/* Encode the chunks that changed, assemble the rafts' blocks and write them
+ * out; runs on the saver thread */
+static void save()
+{
+  static vector<unsigned char> blank;
+  if (blank.empty())
+  {
+    RleEncoder rle(blank);
+    rle.putRun(0, CHUNKSIZE*CHUNKSIZE);
+    rle.finish();
+  }
+
+  unsigned long encoded = 0;
+  blocks.resize(job.table.size());
+  for (size_t i=0; i<job.table.size(); i++)
+  {
+    vector<unsigned char>& block = blocks[i];
+    block.clear();
+    if (job.sources[i].data)
+    {
+      encodeSource(job.sources[i], job.table[i], block);
+      continue;
+    }
+    for (size_t c=job.firstChunk[i]; c<job.firstChunk[i+1]; c++)
+    {
+      const SaveChunk& sc = job.chunks[c];
+      if (!sc.id)
+      {
+        block.insert(block.end(), blank.begin(), blank.end());
+        continue;
+      }
+
+      /* Runs never span chunks, so each chunk's packets can be kept and
+       * strung together on their own */
+      CachedChunk& cached = cache[sc.id];
+      if (sc.copy >= 0)
+      {
+        cached.revision = sc.revision;
+        cached.rle.clear();
+        RleEncoder rle(cached.rle);
+        rle.put(&job.tiles[sc.copy], CHUNKSIZE*CHUNKSIZE);
+        rle.finish();
+        encoded++;
+      }
+      cached.save = saves + failures + 1;
+      block.insert(block.end(), cached.rle.begin(), cached.rle.end());
+    }
+  }
+
+  /* Forget chunks that are gone */
+  for (map<unsigned long long, CachedChunk>::iterator i = cache.begin(); i != cache.end(); )
+  {
+    if (i->second.save != saves + failures + 1)
+      cache.erase(i++);
+    else
+      ++i;
+  }
+
+  uint64_t written = 0;
+  bool ok = MapFile::writeEncoded(job.filename, job.table, blocks, written);
+
+  SDL_LockMutex(lock);
+  lastOk = ok;
+  lastBytes = written;
+  lastLatency = timerSeconds() - job.started;
+  lastSnapshot = job.snapshotTime;
+  lastEncoded = encoded;
+  lastChunks = job.chunks.size();
+  if (ok)
+    saves++;
+  else
+    failures++;
+  SDL_UnlockMutex(lock);
+}
+
+static int saverMain(void *)
+{
+  SDL_LockMutex(lock);
+  for (;;)
+  {
+    while (!busy && !quit)
+      SDL_CondWait(wake, lock);
+    if (!busy)
+      break;
+    SDL_UnlockMutex(lock);
+
+    save();
+
+    SDL_LockMutex(lock);
+    busy = false;
+    finished = true;
+    SDL_CondBroadcast(idle);
+  }
+  SDL_UnlockMutex(lock);
+  return 0;
+}
+
+void autosaveStart()
+{
+  if (saver)
+    return;
+  if (!lock)
+  {
+    lock = SDL_CreateMutex();
+    wake = SDL_CreateCond();
+    idle = SDL_CreateCond();
+  }
+  quit = false;
+  saver = SDL_CreateThread(saverMain, NULL);
+  if (!saver)
+    LOGW(LOG_MAP, "could not start autosave thread: %s\n", SDL_GetError());
+}
+
+void autosaveStop()
+{
+  if (!saver)
+    return;
+  SDL_LockMutex(lock);
+  quit = true;
+  SDL_CondSignal(wake);
+  SDL_UnlockMutex(lock);
+  SDL_WaitThread(saver, NULL);
+  saver = NULL;
+}
+
+void autosaveWait()
+{
+  if (!saver)
+    return;
+  SDL_LockMutex(lock);
+  while (busy)
+    SDL_CondWait(idle, lock);
+  SDL_UnlockMutex(lock);
+}
+
+/* Log the outcome of a save that has finished since the last call. Returns
+ * true if the saver is idle. */
+static bool reap()
+{
+  SDL_LockMutex(lock);
+  bool idle = !busy;
+  bool done = finished;
+  finished = false;
+  SDL_UnlockMutex(lock);
+
+  if (done && lastOk)
+  {
+    savedStamp = pendingStamp;
+    LOGI(LOG_MAP, "autosaved \"%s\": %lu bytes in %.1f ms, %lu of %lu chunks encoded\n",
+        job.filename.c_str(), (unsigned long)lastBytes, lastLatency * 1000, lastEncoded, lastChunks);
+  }
+  else if (done)
+    LOGE(LOG_MAP, "autosave to \"%s\" failed\n", job.filename.c_str());
+  return idle;
+}
+
+bool autosaveNow(const vector<TileRaft*>& rafts)
+{
+  if (!saver || !reap())
+    return false;
+
+  pendingStamp = stamp(rafts);
+  snapshot(rafts);
+
+  SDL_LockMutex(lock);
+  busy = true;
+  SDL_CondSignal(wake);
+  SDL_UnlockMutex(lock);
+  return true;
+}
+
+void autosavePoll(const vector<TileRaft*>& rafts)
+{
+  if (!saver || !reap() || autosaveInterval <= 0)
+    return;
+
+  double now = timerSeconds();
+  /* Whatever is there to begin with needn't be saved; not least, that
+   * would replace the last autosave with an empty map at startup */
+  if (nextSave == 0)
+  {
+    nextSave = now + autosaveInterval;
+    savedStamp = stamp(rafts);
+    return;
+  }
+  if (now < nextSave)
+    return;
+  nextSave = now + autosaveInterval;
+
+  if (stamp(rafts) != savedStamp)
+    autosaveNow(rafts);
+}
+
+void autosaveReport()
+{
+  if (!saver)
+  {
+    conPrint("autosave thread not running\n");
+    return;
+  }
+
+  SDL_LockMutex(lock);
+  if (autosaveInterval > 0)
+    conPrint("autosave every %g s to \"%s\"\n", autosaveInterval, autosaveFilename.c_str());
+  else
+    conPrint("autosave off\n");
+  conPrint("%lu saves, %lu failed%s\n", saves, failures, busy ? ", one running" : "");
+  if (saves + failures)
+  {
+    conPrint("last: %s, %lu bytes, %.1f ms in all, %.2f ms of it on the main thread\n",
+        lastOk ? "ok" : "FAILED", (unsigned long)lastBytes, lastLatency * 1000, lastSnapshot * 1000);
+    conPrint("      %lu of %lu chunks encoded\n", lastEncoded, lastChunks);
+  }
+  SDL_UnlockMutex(lock);
+}
@@ -0,0 +1,46 @@
+#ifndef AUTOSAVE_HXX
+#define AUTOSAVE_HXX
+#include <string>
+#include <vector>
+
+struct TileRaft;
+
+/* Background autosave
+ *
+ * Every autosaveInterval seconds, if the rafts have been edited since the
+ * last autosave, the main thread snapshots them and a saver thread writes
+ * the snapshot to autosaveFilename as a binary map file. The file is
+ * replaced atomically, so a crash mid-save leaves the previous autosave.
+ *
+ * The saver keeps the RLE encoding of every chunk it has written, keyed by
+ * the chunk's id and revision. A snapshot only copies the tiles of chunks
+ * that have changed since; the rest are written from their old encoding
+ * without being looked at again. Rafts still waiting to be paged in from
+ * their map file can't have been edited, and are written from their tile
+ * block there without being paged in. Only one save is in flight at a time,
+ * so a slow disk delays autosaves rather than queueing them up.
+ */
+
+/* Seconds between autosaves, or 0 for none */
+extern double autosaveInterval;
+extern std::string autosaveFilename;
+
+/* Start and stop the saver thread. Stopping waits for a save in progress. */
+void autosaveStart();
+void autosaveStop();
+
+/* Call from the main thread every step. Starts an autosave if one is due,
+ * and logs the outcome of any that has finished. */
+void autosavePoll(const std::vector<TileRaft*>& rafts);
+
+/* Start an autosave now, whether or not anything has changed. Returns
+ * false if the saver isn't running or is still busy with the last one. */
+bool autosaveNow(const std::vector<TileRaft*>& rafts);
+
+/* Wait for a save in progress to finish. Call before unmapping a map file
+ * whose rafts may be being saved from it. */
+void autosaveWait();
+
+/* Print the interval and the latency and size of the last autosave */
+void autosaveReport();
+#endif
@@ -0,0 +1,667 @@
+#include "console.hxx"
+#include "interactive-application.hxx"
+#include "world.hxx"
+#include "tile-raft.hxx"
+#include "tile-mesh.hxx"
+#include "tileset.hxx"
+#include "mapfile.hxx"
+#include "gl-renderer.hxx"
+#include "region.hxx"
+#include "timer.hxx"
+#include "job-pool.hxx"
+#include "pathfind.hxx"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include <new>
+#ifdef __MACH__
+#  include <OpenGL/gl.h>
+#else
+#  include <GL/gl.h>
+#endif
+using namespace std;
+
+extern int ScreenWidth, ScreenHeight;
+
+/* The bench* console commands. Each times one part of the game and prints
+ * what it found with conPrint(). */
+namespace Game
+{
+    /* Load a map "times" times, with rafts allocated from the heap and then
+     * from an arena, and report the average load time and allocation counts
+     * of each. Every raft is paged in, so that lazily-loaded binary maps are
+     * measured doing the same work as text maps. */
+    void BenchLoad(string filename, int times)
+    {
+      filename = mapFilename(filename);
+      if (times <= 0)
+        return;
+
+      conPrint("benchload: \"%s\" %s, %d loads\n", filename.c_str(),
+          MapFile::detect(filename) ? "binary" : "text", times);
+      for (int pass=0; pass<2; pass++)
+      {
+        World world;
+        world.useArena = pass == 1;
+        unsigned long heap0 = tileHeapAllocations;
+
+        double t0 = timerSeconds();
+        for (int i=0; i<times; i++)
+        {
+          if (!loadWorld(filename, &world))
+            return;
+          for (vector<TileRaft*>::iterator raft = world.rafts.begin(); raft != world.rafts.end(); ++raft)
+            (*raft)->page();
+        }
+        world.clear();
+        double t1 = timerSeconds();
+
+        conPrint("  %s: %g ms/load, %g chunk allocations/load from the heap, "
+            "%g from the arena, %lu arena blocks\n",
+            pass ? "arena" : "heap ",
+            (t1 - t0) * 1000 / times,
+            (tileHeapAllocations - heap0) / (double)times,
+            world.arena.allocations / (double)times,
+            world.arena.blockAllocations);
+      }
+    }
+
+    /* A size*size maze: passages of tile 1 on a background of tile 0,
+     * carved depth first from (1, 1), with walls knocked out here and there
+     * so that there are loops, and a few rooms cleared out */
+    static TileRaft *makeMaze(int size, unsigned int seed)
+    {
+      vector<unsigned char> tiles(size * size, 0);
+      int cells = (size - 1) / 2;
+      vector<int> stack;
+      tiles[1 + 1 * size] = 1;
+      stack.push_back(0);
+      while (!stack.empty())
+      {
+        int c = stack.back(), cx = c % cells, cy = c / cells;
+        int dirs[4], n = 0;
+        static const int dx[] = { 1, -1, 0, 0 }, dy[] = { 0, 0, 1, -1 };
+        for (int d=0; d<4; d++)
+        {
+          int nx = cx + dx[d], ny = cy + dy[d];
+          if (nx >= 0 && ny >= 0 && nx < cells && ny < cells && !tiles[1 + 2*nx + (1 + 2*ny) * size])
+            dirs[n++] = d;
+        }
+        if (!n)
+        {
+          stack.pop_back();
+          continue;
+        }
+        seed = seed * 1103515245 + 12345;
+        int d = dirs[(seed >> 16) % n];
+        tiles[1 + 2*cx + dx[d] + (1 + 2*cy + dy[d]) * size] = 1;
+        tiles[1 + 2*(cx + dx[d]) + (1 + 2*(cy + dy[d])) * size] = 1;
+        stack.push_back(cx + dx[d] + (cy + dy[d]) * cells);
+      }
+
+      for (int i=0; i<size*size/32; i++)
+      {
+        seed = seed * 1103515245 + 12345;
+        int x = 1 + (seed >> 8) % (size - 2), y = 1 + (seed >> 20) % (size - 2);
+        tiles[x + y * size] = 1;
+      }
+      for (int i=0; i<size*size/4096; i++)
+      {
+        seed = seed * 1103515245 + 12345;
+        int x0 = 1 + (seed >> 8) % (size - 18), y0 = 1 + (seed >> 20) % (size - 18);
+        int w = 4 + (seed >> 4) % 13, h = 4 + (seed >> 27) % 13;
+        for (int y=y0; y<y0+h; y++)
+          memset(&tiles[x0 + y * size], 1, w);
+      }
+
+      TileRaft *raft = new TileRaft(size, size);
+      for (int y=0; y<size; y++)
+        raft->setRow(0, y, size, &tiles[y * size]);
+      return raft;
+    }
+
+    /* Time path queries between random points of a size*size maze: the
+     * cost of building and of updating its navigation grid, A* against
+     * jump point search, and batches of queries spread over the job pool */
+    void BenchPaths(int size, int nqueries)
+    {
+      if (size < 64 || nqueries <= 0)
+        return;
+      int oldThreads = jobThreads();
+      TileRaft *maze = makeMaze(size, 1);
+
+      NavGrid grid;
+      double t0 = timerSeconds();
+      grid.update(*maze);
+      double buildMs = (timerSeconds() - t0) * 1000;
+      int chunks = grid.chunksBuilt;
+      maze->set(size / 2, size / 2, 0);
+      t0 = timerSeconds();
+      grid.update(*maze);
+      double editMs = (timerSeconds() - t0) * 1000;
+      conPrint("benchpaths: %dx%d maze, %d queries\n", size, size, nqueries);
+      conPrint("  nav grid: built in %.2f ms, updated after an edit in %.3f ms (%d of %d chunks)\n",
+          buildMs, editMs, grid.chunksBuilt, chunks);
+
+      /* Passages run along odd rows and columns */
+      vector<PathQuery> queries(nqueries);
+      unsigned int seed = 2;
+      int cells = (size - 1) / 2;
+      for (int i=0; i<nqueries; i++)
+      {
+        PathQuery& q = queries[i];
+        q.grid = &grid;
+        seed = seed * 1103515245 + 12345;
+        q.x0 = 1 + 2 * ((seed >> 8) % cells);
+        seed = seed * 1103515245 + 12345;
+        q.y0 = 1 + 2 * ((seed >> 8) % cells);
+        seed = seed * 1103515245 + 12345;
+        q.x1 = 1 + 2 * ((seed >> 8) % cells);
+        seed = seed * 1103515245 + 12345;
+        q.y1 = 1 + 2 * ((seed >> 8) % cells);
+      }
+
+      /* A* is slow enough to only be worth running on a sample */
+      jobStart(1);
+      vector<PathQuery> sample(queries.begin(), queries.begin() + min(nqueries, 100));
+      const char *names[] = { "A*", "JPS" };
+      vector<PathQuery> *runs[] = { &sample, &queries };
+      for (int k=0; k<2; k++)
+      {
+        t0 = timerSeconds();
+        navFindPaths(*runs[k], k == 1);
+        double s = timerSeconds() - t0;
+        long expanded = 0;
+        for (size_t i=0; i<runs[k]->size(); i++)
+          expanded += (*runs[k])[i].path.expanded;
+        conPrint("  %-4s %9.0f queries/s, %8.1f nodes expanded per query\n",
+            names[k], runs[k]->size() / s, expanded / (double)runs[k]->size());
+      }
+      int mismatches = 0;
+      for (size_t i=0; i<sample.size(); i++)
+        if (sample[i].found != queries[i].found || sample[i].path.cost != queries[i].path.cost)
+          mismatches++;
+      conPrint("  JPS and A* path costs differ on %d of %d queries\n", mismatches, (int)sample.size());
+
+      conPrint("%9s %10s %10s %9s %9s\n", "threads", "ms", "queries/s", "speedup", "checksum");
+      vector<int> counts;
+      for (int n=1; n<cpuCount(); n = n < 4 ? n + 1 : n * 2)
+        counts.push_back(n);
+      counts.push_back(cpuCount());
+      double base = 0;
+      for (size_t k=0; k<counts.size(); k++)
+      {
+        jobStart(counts[k]);
+        t0 = timerSeconds();
+        navFindPaths(queries);
+        double ms = (timerSeconds() - t0) * 1000;
+        uint32_t sum = 1;
+        for (int i=0; i<nqueries; i++)
+          if (queries[i].found)
+            sum = mapChecksum((const unsigned char*)&queries[i].path.points[0],
+                queries[i].path.points.size() * sizeof(int), sum);
+        if (k == 0)
+          base = ms;
+        conPrint("%9d %10.2f %10.0f %8.2fx  %08x\n",
+            jobThreads(), ms, nqueries * 1000 / ms, base / ms, (unsigned int)sum);
+      }
+
+      jobStart(oldThreads);
+      delete maze;
+    }
+
+    /* Step worlds of 10 to 10000 small rafts with random velocities, one to
+     * each cell of a grid so that they start out apart, and report the cost
+     * per step */
+    void BenchRafts()
+    {
+      const int steps = 100;
+      conPrint("benchrafts: %d steps each\n", steps);
+      for (int n=10; n<=10000; n*=10)
+      {
+        World world;
+        const int cell = 8 * TILESIZE * 3;
+        int cells = (int)ceil(sqrt((double)n));
+        for (int i=0; i<n; i++)
+        {
+          TileRaft *raft = new (world.arena.alloc(sizeof(TileRaft))) TileRaft(8, 8, &world.arena);
+          for (int t=0; t<8*8; t++)
+            if (random() % 2)
+              raft->set(t % 8, t / 8, 1 + random() % 255);
+          raft->xOff = i % cells * cell + random() % (cell - 8 * TILESIZE);
+          raft->yOff = i / cells * cell + random() % (cell - 8 * TILESIZE);
+          world.addRaft(raft);
+          world.raftVX[i] = random() % 9 - 4;
+          world.raftVY[i] = random() % 9 - 4;
+        }
+
+        long pairs = 0, collisions = 0;
+        double t0 = timerSeconds();
+        for (int s=0; s<steps; s++)
+        {
+          world.step();
+          pairs += world.lastPairs;
+          collisions += world.lastCollisions;
+        }
+        double t1 = timerSeconds();
+
+        conPrint("  %5d rafts: %8.3f ms/step, %7.1f pairs/step, %6.1f collisions/step\n",
+            n, (t1 - t0) * 1000 / steps, pairs / (double)steps, collisions / (double)steps);
+      }
+    }
+
+    /* A world of n 64x64 rafts of runs of tiles, one to each cell of a grid
+     * and moving at random. The same n always gives the same world. */
+    static void makeBenchWorld(World& world, int n)
+    {
+      unsigned int seed = 1;
+      const int side = 64, cell = side * TILESIZE * 2;
+      int cells = (int)ceil(sqrt((double)n));
+      for (int i=0; i<n; i++)
+      {
+        TileRaft *raft = new (world.arena.alloc(sizeof(TileRaft))) TileRaft(side, side, &world.arena);
+        for (int t=0; t<side*side; )
+        {
+          seed = seed * 1103515245 + 12345;
+          unsigned char tile = seed >> 16 & 3 ? seed >> 8 : 0;
+          for (int run = 1 + (seed >> 20) % 48; run && t < side*side; run--, t++)
+            raft->set(t % side, t / side, tile);
+        }
+        raft->xOff = i % cells * cell + (seed >> 4) % (cell - side * TILESIZE);
+        raft->yOff = i / cells * cell + (seed >> 12) % (cell - side * TILESIZE);
+        world.addRaft(raft);
+        world.raftVX[i] = (int)(seed >> 24) % 17 - 8;
+        world.raftVY[i] = (int)(seed >> 28) % 9 - 4;
+      }
+    }
+
+    struct EncodeBench {
+      World *world;
+      vector< vector<unsigned char> > encoded;
+    };
+
+    static void encodeRafts(void *data, int begin, int end)
+    {
+      EncodeBench& bench = *(EncodeBench*)data;
+      for (int i=begin; i<end; i++)
+      {
+        bench.encoded[i].clear();
+        MapFile::encodeRaft(*bench.world->rafts[i], bench.encoded[i]);
+      }
+    }
+
+    /* Time the work done on the job pool with 1 thread and up to one per CPU:
+     * rebuilding chunk meshes, encoding rafts for saving, and stepping a
+     * world of colliding rafts. Each pass starts from the same world, and
+     * the checksum of its results must come out the same every time. */
+    void BenchJobs()
+    {
+      const int nrafts = 256, steps = 100;
+      int oldThreads = jobThreads();
+      bool oldBatched = glRenderer.batched;
+      glRenderer.batched = true;
+      double base[3] = { 0, 0, 0 };
+
+      conPrint("benchjobs: %d 64x64 rafts, %d steps\n", nrafts, steps);
+      conPrint("%7s %10s %10s %10s %9s\n", "threads", "mesh ms", "encode ms", "step ms", "checksum");
+      vector<int> counts;
+      for (int n=1; n<cpuCount(); n = n < 4 ? n + 1 : n * 2)
+        counts.push_back(n);
+      counts.push_back(cpuCount());
+
+      for (size_t k=0; k<counts.size(); k++)
+      {
+        int n = counts[k];
+        jobStart(n);
+        World world;
+        makeBenchWorld(world, nrafts);
+        double ms[3];
+
+        vector<TileChunk*> chunks;
+        for (int i=0; i<nrafts; i++)
+          for (size_t c=0; c<world.rafts[i]->chunks.size(); c++)
+            if (world.rafts[i]->chunks[c])
+              chunks.push_back(world.rafts[i]->chunks[c]);
+        double t0 = timerSeconds();
+        glRenderer.prepareChunks(&chunks[0], chunks.size());
+        ms[0] = (timerSeconds() - t0) * 1000;
+
+        EncodeBench bench;
+        bench.world = &world;
+        bench.encoded.resize(nrafts);
+        t0 = timerSeconds();
+        parallelFor(nrafts, 1, encodeRafts, &bench);
+        ms[1] = (timerSeconds() - t0) * 1000;
+
+        t0 = timerSeconds();
+        for (int s=0; s<steps; s++)
+          world.step();
+        ms[2] = (timerSeconds() - t0) * 1000;
+
+        uint32_t sum = 1;
+        for (size_t c=0; c<chunks.size(); c++)
+          sum = mapChecksum((const unsigned char*)&chunks[c]->mesh.texCoords[0],
+              chunks[c]->mesh.texCoords.size() * sizeof(GLfloat), sum);
+        for (int i=0; i<nrafts; i++)
+        {
+          sum = mapChecksum(&bench.encoded[i][0], bench.encoded[i].size(), sum);
+          sum = mapChecksum((const unsigned char*)&world.raftX[i], sizeof(int), sum);
+          sum = mapChecksum((const unsigned char*)&world.raftY[i], sizeof(int), sum);
+        }
+
+        if (n == 1)
+          for (int p=0; p<3; p++)
+            base[p] = ms[p];
+        conPrint("%7d %10.2f %10.2f %10.2f  %08x\n", jobThreads(), ms[0], ms[1], ms[2], (unsigned int)sum);
+        conPrint("%7s %9.2fx %9.2fx %9.2fx\n", "speedup",
+            base[0] / ms[0], base[1] / ms[1], base[2] / ms[2]);
+      }
+      glRenderer.batched = oldBatched;
+      jobStart(oldThreads);
+    }
+
+    /* Time bucket fills on a raft of about "megatiles" million tiles, laid out
+     * as the worst cases for a scanline fill: a serpentine corridor one tile
+     * wide, which makes every span a single row long and reverses direction
+     * at each end, and a checkerboard, where 8-connected spans are one tile
+     * long. */
+    void BenchBucket(int megatiles)
+    {
+      int side = (int)ceil(sqrt(max(megatiles, 1) * 1048576.0));
+      TileRaft raft(side, side);
+      BucketStack stack;
+
+      for (int pass=0; pass<3; pass++)
+      {
+        regionFill(raft, 0, 0, side, side, 0);
+        const char *name;
+        if (pass == 0)
+        {
+          name = "serpentine";
+          for (int y=1; y<side; y+=2)
+          {
+            regionFill(raft, 0, y, side, y + 1, 1);
+            raft.set(y % 4 == 1 ? side - 1 : 0, y, 0);
+          }
+        }
+        else
+        {
+          name = pass == 1 ? "checker, 4-conn" : "checker, 8-conn";
+          for (int y=0; y<side; y++)
+          for (int x=y%2; x<side; x+=2)
+            raft.set(x, y, 1);
+        }
+
+        double t0 = timerSeconds();
+        size_t n = regionBucketFill(raft, 0, 0, 2, pass == 2, stack);
+        double t1 = timerSeconds();
+        conPrint("benchbucket: %-16s %dx%d, %lu tiles in %.2f ms, %.1f Mtiles/s, stack depth %lu\n",
+            name, side, side, (unsigned long)n, (t1 - t0) * 1000,
+            n / max(t1 - t0, 1e-9) / 1e6, (unsigned long)stack.maxDepth);
+      }
+
+      /* Undo should cost what the fill changed, not the size of the raft */
+      World world;
+      TileRaft *hole = new TileRaft(side, side);
+      regionFill(*hole, 0, 0, side, side, 1);
+      hole->set(side / 2, side / 2, 0);
+      world.addRaft(hole);
+      double t0 = timerSeconds();
+      world.bucketFill(0, side / 2, side / 2, 2, false, stack);
+      double t1 = timerSeconds();
+      size_t bytes = world.journal.bytes;
+      bool ok = bytes < 1024 && world.journal.undo(world.rafts) && hole->get(side / 2, side / 2) == 0
+             && world.journal.redo(world.rafts) && hole->get(side / 2, side / 2) == 2;
+      conPrint("benchbucket: 1-tile fill journaled in %lu bytes, %.3f ms, %s\n",
+          (unsigned long)bytes, (t1 - t0) * 1000, ok ? "ok" : "FAILED");
+    }
+
+    /* Time the region operations on a raft of about "megatiles" million tiles,
+     * against filling it with TileRaft :: set() */
+    void BenchRegion(int megatiles)
+    {
+      int side = (int)ceil(sqrt(max(megatiles, 1) * 1048576.0));
+      /* Keep the rectangles off the chunk grid so that the partial-chunk
+       * paths are exercised too */
+      int x0 = 7, y0 = 5, x1 = side - 9, y1 = side - 3;
+      double mtiles = (double)(x1 - x0) * (y1 - y0) / 1e6;
+      TileRaft a(side, side), b(side, side);
+      TileRegion region;
+      double t[6];
+
+      t[0] = timerSeconds();
+      for (int y=y0; y<y1; y++)
+      for (int x=x0; x<x1; x++)
+        a.set(x, y, 1);
+      t[1] = timerSeconds();
+      regionFill(a, x0, y0, x1, y1, 2);
+      t[2] = timerSeconds();
+      regionCopy(a, x0, y0, x1, y1, region);
+      t[3] = timerSeconds();
+      regionPaste(b, region, x0 + 3, y0 + 1);
+      t[4] = timerSeconds();
+      regionBlit(b, 0, 0, a, x0, y0, x1, y1, true);
+      t[5] = timerSeconds();
+
+      static const char *names[] = { "set() loop", "fill", "copy", "paste", "masked blit" };
+      conPrint("benchregion: %dx%d raft, %.1f Mtiles per operation\n", side, side, mtiles);
+      for (int i=0; i<5; i++)
+        conPrint("  %-12s %8.2f ms  %8.1f Mtiles/s\n", names[i],
+            (t[i+1] - t[i]) * 1000, mtiles / max(t[i+1] - t[i], 1e-9));
+    }
+
+    /* Render the active world "frames" times with each drawing path and
+     * report the average frame time of both. glFinish() is called after each
+     * frame so that we measure the GL's work and not just command queuing. */
+    void BenchDraw(int frames)
+    {
+      if (frames <= 0)
+        return;
+
+      bool oldBatched = glRenderer.batched;
+      bool oldCached = glRenderer.cached;
+      double ms[3];
+      int tiles = 0;
+      for (vector<TileRaft*>::iterator raft = activeWorld->rafts.begin(); raft != activeWorld->rafts.end(); ++raft)
+        tiles += (*raft)->width * (*raft)->height;
+
+      for (int pass=0; pass<3; pass++)
+      {
+        glRenderer.batched = pass >= 1;
+        glRenderer.cached = pass == 2;
+        /* Warm up, so that meshes are built and chunks cached before we
+         * start timing */
+        Draw();
+        glFinish();
+
+        double t0 = timerSeconds();
+        for (int i=0; i<frames; i++)
+        {
+          glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+          Draw();
+          glFinish();
+        }
+        ms[pass] = (timerSeconds() - t0) * 1000 / frames;
+      }
+      glRenderer.batched = oldBatched;
+      glRenderer.cached = oldCached;
+
+      conPrint("benchdraw: %d tiles, %d frames\n", tiles, frames);
+      conPrint("  immediate: %g ms/frame\n", ms[0]);
+      conPrint("  batched:   %g ms/frame\n", ms[1]);
+      conPrint("  cached:    %g ms/frame\n", ms[2]);
+    }
+
+    /* Build a synthetic raft of at least "tiles" tiles made of runs of random
+     * length, the way fills leave a map, and time RLE encoding and decoding
+     * it. The decoded raft is checked against the original. */
+    void BenchRle(int tiles)
+    {
+      int side = (int)ceil(sqrt((double)max(tiles, 1)));
+      TileRaft src(side, side);
+      int x = 0, y = 0;
+      while (y < side)
+      {
+        unsigned char tile = random() % 4 ? random() % 256 : 0;
+        int run = 1 + random() % (random() % 8 ? 64 : 4096);
+        for (; run && y < side; run--)
+        {
+          src.set(x, y, tile);
+          if (++x == side) { x = 0; y++; }
+        }
+      }
+
+      const int times = 10;
+      vector<unsigned char> encoded;
+      double t0 = timerSeconds();
+      for (int i=0; i<times; i++)
+      {
+        encoded.clear();
+        MapFile::encodeRaft(src, encoded);
+      }
+      double t1 = timerSeconds();
+      bool ok = true;
+      for (int i=0; i<times && ok; i++)
+      {
+        TileRaft dst(side, side);
+        ok = MapFile::decodeRaft(dst, &encoded[0], encoded.size());
+        if (i == 0)
+          for (int y=0; y<side && ok; y++)
+          for (int x=0; x<side && ok; x++)
+            ok = src.get(x, y) == dst.get(x, y);
+      }
+      double t2 = timerSeconds();
+
+      double mb = (double)src.chunks.size() * CHUNKSIZE*CHUNKSIZE * times / (1024 * 1024);
+      conPrint("benchrle: %dx%d tiles, %u bytes encoded (%.1f%%), round trip %s\n",
+          side, side, (unsigned int)encoded.size(),
+          100.0 * encoded.size() / ((double)src.chunks.size() * CHUNKSIZE*CHUNKSIZE),
+          ok ? "ok" : "FAILED");
+      conPrint("  encode: %g MB/s\n", mb / max(t1 - t0, 1e-9));
+      conPrint("  decode: %g MB/s\n", mb / max(t2 - t1, 1e-9));
+    }
+
+    /* The tile emitting loop as it was before tile sets had UV tables, for
+     * BenchTiles() to compare against */
+    static void emitComputed(TileMesh& mesh, const unsigned char *tiles, int width, int height)
+    {
+      mesh.vertices.resize(width * height * 8);
+      mesh.texCoords.resize(width * height * 8);
+      GLfloat *v = &mesh.vertices[0];
+      GLfloat *t = &mesh.texCoords[0];
+      for (int y=0; y<height; y++)
+      for (int x=0; x<width; x++)
+      {
+        unsigned char tile = *tiles++;
+        GLdouble vx0 = x * TILESIZE, vy0 = y * TILESIZE;
+        GLdouble vx1 = vx0 + TILESIZE, vy1 = vy0 + TILESIZE;
+        GLdouble tx0 = (tile%TILESETW) / (GLdouble)TILESETW;
+        GLdouble ty0 = (tile/TILESETW) / (GLdouble)TILESETH;
+        GLdouble tx1 = (tile%TILESETW+1) / (GLdouble)TILESETW;
+        GLdouble ty1 = (tile/TILESETW+1) / (GLdouble)TILESETH;
+        v[0] = vx0; v[1] = vy0; t[0] = tx0; t[1] = ty0;
+        v[2] = vx1; v[3] = vy0; t[2] = tx1; t[3] = ty0;
+        v[4] = vx1; v[5] = vy1; t[4] = tx1; t[5] = ty1;
+        v[6] = vx0; v[7] = vy1; t[6] = tx0; t[7] = ty1;
+        v += 8;
+        t += 8;
+      }
+    }
+
+    /* Time emitting about "megatiles" million tiles into a mesh, computing
+     * each tile's texture coordinates as drawTile() used to, and from the
+     * UV tables of 8, 16 and 32 pixel tile sets */
+    void BenchTiles(int megatiles)
+    {
+      const int side = CHUNKSIZE;
+      int times = max(1, (int)(megatiles * 1048576.0 / (side * side)));
+      vector<unsigned char> tiles(side * side);
+      for (size_t i=0; i<tiles.size(); i++)
+        tiles[i] = random();
+
+      TileMesh mesh;
+      double ms[4];
+      for (int pass=0; pass<4; pass++)
+      {
+        double t0 = timerSeconds();
+        for (int i=0; i<times; i++)
+        {
+          if (pass == 0)
+            emitComputed(mesh, &tiles[0], side, side);
+          else if (pass == 1)
+            mesh.build<Tileset8>(&tiles[0], side, side);
+          else if (pass == 2)
+            mesh.build<Tileset16>(&tiles[0], side, side);
+          else
+            mesh.build<Tileset32>(&tiles[0], side, side);
+        }
+        ms[pass] = (timerSeconds() - t0) * 1000;
+      }
+
+      double mtiles = (double)side * side * times / 1e6;
+      conPrint("benchtiles: %.1f million tiles\n", mtiles);
+      conPrint("  computed: %7.1f Mtiles/s\n", mtiles / ms[0] * 1000);
+      conPrint("  table 8:  %7.1f Mtiles/s\n", mtiles / ms[1] * 1000);
+      conPrint("  table 16: %7.1f Mtiles/s\n", mtiles / ms[2] * 1000);
+      conPrint("  table 32: %7.1f Mtiles/s\n", mtiles / ms[3] * 1000);
+    }
+
+    /* Draw a world of nrafts rafts centered at a range of zooms, from 1:1
+     * out to the whole world fitting on screen, to show that the level of
+     * detail keeps the cost of a frame about level however far out it is */
+    void BenchZoom(int nrafts)
+    {
+      if (nrafts <= 0)
+        return;
+
+      World w;
+      makeBenchWorld(w, nrafts);
+      for (int i=0; i<nrafts; i++)
+        w.raftVX[i] = w.raftVY[i] = 0;
+      w.editMode = false;
+
+      int x0 = w.raftX[0], y0 = w.raftY[0], x1 = x0 + w.raftW[0], y1 = y0 + w.raftH[0];
+      for (int i=1; i<nrafts; i++)
+      {
+        x0 = min(x0, w.raftX[i]);
+        y0 = min(y0, w.raftY[i]);
+        x1 = max(x1, w.raftX[i] + w.raftW[i]);
+        y1 = max(y1, w.raftY[i] + w.raftH[i]);
+      }
+      double fit = min((double)ScreenWidth / (x1 - x0), (double)ScreenHeight / (y1 - y0));
+
+      World *oldWorld = activeWorld;
+      activeWorld = &w;
+      const int frames = 20;
+      conPrint("benchzoom: %d rafts, %d tiles, %d frames per zoom\n", nrafts, w.totalTiles, frames);
+      for (double zoom=1; ; zoom/=4)
+      {
+        if (zoom < fit)
+          zoom = fit;
+        Camera& c = w.camera;
+        c.zoom = c.prevZoom = c.targetZoom = zoom;
+        c.x = c.prevX = (x0 + x1) / 2.0 - ScreenWidth / 2 / zoom;
+        c.y = c.prevY = (y0 + y1) / 2.0 - ScreenHeight / 2 / zoom;
+
+        /* Warm up, so that meshes and overviews are built first */
+        Draw();
+        glFinish();
+
+        double t0 = timerSeconds();
+        for (int i=0; i<frames; i++)
+        {
+          glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+          Draw();
+          glFinish();
+        }
+        double ms = (timerSeconds() - t0) * 1000 / frames;
+        conPrint("  zoom %-10g %8.3f ms/frame  lod %d  %7d tiles  %6d overviews\n",
+            zoom, ms, lastLod, tilesSubmitted, overviewsSubmitted);
+        if (zoom <= fit)
+          break;
+      }
+      activeWorld = oldWorld;
+    }
+};
@@ -0,0 +1,64 @@
+#include "camera.hxx"
+#include <math.h>
+
+Camera::Camera() :
+  x(0),
+  y(0),
+  zoom(1),
+  prevX(0),
+  prevY(0),
+  prevZoom(1),
+  targetZoom(1),
+  anchorX(0),
+  anchorY(0),
+  panX(0),
+  panY(0)
+{
+}
+
+void Camera::step()
+{
+  prevX = x;
+  prevY = y;
+  prevZoom = zoom;
+
+  x += panX * CAMERA_PANSPEED / zoom;
+  y += panY * CAMERA_PANSPEED / zoom;
+
+  if (zoom != targetZoom)
+  {
+    /* Ease in log space, so that zooming feels the same at every scale */
+    double wx = worldX(anchorX), wy = worldY(anchorY);
+    zoom *= pow(targetZoom / zoom, CAMERA_EASE);
+    if (fabs(log(targetZoom / zoom)) < 0.001)
+      zoom = targetZoom;
+    x = wx - anchorX / zoom;
+    y = wy - anchorY / zoom;
+  }
+}
+
+void Camera::zoomBy(double factor, int sx, int sy)
+{
+  targetZoom *= factor;
+  if (targetZoom < CAMERA_MINZOOM)
+    targetZoom = CAMERA_MINZOOM;
+  if (targetZoom > CAMERA_MAXZOOM)
+    targetZoom = CAMERA_MAXZOOM;
+  anchorX = sx;
+  anchorY = sy;
+}
+
+void Camera::drag(int dx, int dy)
+{
+  x -= dx / zoom;
+  y -= dy / zoom;
+  prevX -= dx / prevZoom;
+  prevY -= dy / prevZoom;
+}
+
+void Camera::view(double alpha, double& vx, double& vy, double& vzoom) const
+{
+  vzoom = prevZoom * pow(zoom / prevZoom, alpha);
+  vx = floor((prevX + (x - prevX) * alpha) * vzoom + 0.5) / vzoom;
+  vy = floor((prevY + (y - prevY) * alpha) * vzoom + 0.5) / vzoom;
+}
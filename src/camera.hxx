@@ -0,0 +1,56 @@
+#ifndef CAMERA_HXX
+#define CAMERA_HXX
+
+/* Zoom limits, in screen pixels per world pixel */
+#define CAMERA_MINZOOM (1.0 / 1024)
+#define CAMERA_MAXZOOM 8.0
+/* Screen pixels per step that held pan keys scroll by */
+#define CAMERA_PANSPEED 12
+/* Fraction of the remaining way to its target that the zoom eases each step */
+#define CAMERA_EASE 0.3
+
+/* A view onto the world: the world pixel at the top left of the screen, and
+ * how many screen pixels each world pixel covers. Zooming eases towards its
+ * target over a few steps, keeping the point it was aimed at still on the
+ * screen. Like rafts, the view is drawn between its last two positions. */
+struct Camera {
+  double x;
+  double y;
+  double zoom;
+
+  /* The view as of the step before */
+  double prevX;
+  double prevY;
+  double prevZoom;
+
+  /* The zoom being eased towards, and the screen point held still while
+   * it is */
+  double targetZoom;
+  int anchorX;
+  int anchorY;
+
+  /* Direction held down on the pan keys, -1, 0 or 1 on each axis */
+  int panX;
+  int panY;
+
+  Camera();
+
+  /* Scroll by the pan keys and ease the zoom */
+  void step();
+
+  /* Multiply the zoom by factor, keeping screen point (sx, sy) still */
+  void zoomBy(double factor, int sx, int sy);
+
+  /* Move the view by (dx, dy) screen pixels, at once, e.g. to follow the
+   * mouse when dragged */
+  void drag(int dx, int dy);
+
+  /* The view to draw with, alpha of the way from the last step to this one.
+   * It is snapped to whole screen pixels, so that tiles don't shimmer. */
+  void view(double alpha, double& vx, double& vy, double& vzoom) const;
+
+  /* The world pixel under screen pixel (sx, sy) */
+  double worldX(int sx) const { return x + sx / zoom; }
+  double worldY(int sy) const { return y + sy / zoom; }
+};
+#endif
@@ -0,0 +1,91 @@
+#include "chunk-cache.hxx"
+
+using namespace std;
+
+ChunkCache::ChunkCache() :
+  budget(CHUNKCACHE_DEFAULT_BUDGET),
+  hits(0),
+  captures(0),
+  evictions(0)
+{
+}
+
+GLuint ChunkCache::lookup(unsigned long long id, int piece, unsigned int revision)
+{
+  Key k = { id, piece };
+  map<Key, Entry>::iterator e = entries.find(k);
+  if (e == entries.end() || e->second.revision != revision)
+    return 0;
+  lru.splice(lru.begin(), lru, e->second.use);
+  hits++;
+  return e->second.texture;
+}
+
+/* Drop the least recently used entry, returning its texture */
+GLuint ChunkCache::evict()
+{
+  map<Key, Entry>::iterator e = entries.find(lru.back());
+  GLuint texture = e->second.texture;
+  entries.erase(e);
+  lru.pop_back();
+  evictions++;
+  return texture;
+}
+
+GLuint ChunkCache::insert(unsigned long long id, int piece, unsigned int revision)
+{
+  Key k = { id, piece };
+  captures++;
+
+  /* A stale entry for the same piece is simply brought up to date */
+  map<Key, Entry>::iterator e = entries.find(k);
+  if (e != entries.end())
+  {
+    e->second.revision = revision;
+    lru.splice(lru.begin(), lru, e->second.use);
+    return e->second.texture;
+  }
+
+  if (budget < CHUNKCACHE_PIECE_BYTES)
+    return 0;
+
+  GLuint texture = 0;
+  if (bytes() + CHUNKCACHE_PIECE_BYTES > budget)
+    texture = evict();
+  else
+  {
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, CHUNKCACHE_PIECE, CHUNKCACHE_PIECE, 0,
+        GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+  }
+
+  lru.push_front(k);
+  Entry& n = entries[k];
+  n.texture = texture;
+  n.revision = revision;
+  n.use = lru.begin();
+  return texture;
+}
+
+void ChunkCache::clear()
+{
+  for (map<Key, Entry>::iterator e = entries.begin(); e != entries.end(); ++e)
+    glDeleteTextures(1, &e->second.texture);
+  entries.clear();
+  lru.clear();
+}
+
+void ChunkCache::setBudget(size_t budget_)
+{
+  budget = budget_;
+  while (!entries.empty() && bytes() > budget)
+  {
+    GLuint texture = evict();
+    glDeleteTextures(1, &texture);
+  }
+}
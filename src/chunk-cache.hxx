@@ -0,0 +1,76 @@
+#ifndef CHUNK_CACHE_HXX
+#define CHUNK_CACHE_HXX
+#ifdef __MACH__
+#  include <OpenGL/gl.h>
+#else
+#  include <GL/gl.h>
+#endif
+#include <stddef.h>
+#include <list>
+#include <map>
+
+/* Chunks drawn to textures, so that an unchanged chunk can be drawn as a
+ * few textured quads instead of a quad per tile
+ *
+ * Chunks are cached in square pieces of CHUNKCACHE_PIECE pixels, drawn at
+ * zoom 1 into textures of their own through a framebuffer object, or where
+ * there are none, copied out of the back buffer (see
+ * GLRenderer :: drawCached()). Each entry remembers the chunk revision it
+ * shows, and is redrawn when the chunk's revision moves on. Textures are
+ * recycled from the least recently used entries once the cache reaches its
+ * budget.
+ */
+#define CHUNKCACHE_PIECE 256
+/* Counting the mipmaps of pieces drawn offscreen */
+#define CHUNKCACHE_PIECE_BYTES (CHUNKCACHE_PIECE * CHUNKCACHE_PIECE * 4 * 4 / 3)
+#define CHUNKCACHE_DEFAULT_BUDGET (64 << 20)
+
+struct ChunkCache {
+  size_t budget;
+
+  /* Pieces drawn from the cache, and captured into it */
+  unsigned long hits;
+  unsigned long captures;
+  unsigned long evictions;
+
+  ChunkCache();
+
+  /* Texture showing piece of chunk id as of revision, or 0 */
+  GLuint lookup(unsigned long long id, int piece, unsigned int revision);
+
+  /* Texture to capture piece of chunk id as of revision into, or 0 if the
+   * budget doesn't allow even one piece */
+  GLuint insert(unsigned long long id, int piece, unsigned int revision);
+
+  /* Delete every texture; the GL context must still be current */
+  void clear();
+  void setBudget(size_t budget);
+
+  size_t size() const { return entries.size(); }
+  size_t bytes() const { return entries.size() * CHUNKCACHE_PIECE_BYTES; }
+
+private:
+  struct Key {
+    unsigned long long id;
+    int piece;
+
+    bool operator<(const Key& k) const
+    {
+      return id != k.id ? id < k.id : piece < k.piece;
+    }
+  };
+
+  struct Entry {
+    GLuint texture;
+    unsigned int revision;
+    /* Position in lru */
+    std::list<Key>::iterator use;
+  };
+
+  std::map<Key, Entry> entries;
+  /* Most recently used first */
+  std::list<Key> lru;
+
+  GLuint evict();
+};
+#endif
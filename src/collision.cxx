@@ -0,0 +1,127 @@
+#include "collision.hxx"
+#include "tile-raft.hxx"
+#include <algorithm>
+
+using namespace std;
+
+static inline int floorDiv(int a, int b)
+{
+  return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+void SolidMask::update(const TileRaft& raft)
+{
+  if (raft.revision == revision && width == raft.width && height == raft.height)
+    return;
+
+  revision = raft.revision;
+  width = raft.width;
+  height = raft.height;
+  words = (width + 63) / 64;
+  bits.assign(words * height, 0);
+
+  vector<unsigned char> row(width);
+  for (int y=0; y<height; y++)
+  {
+    raft.getRow(0, y, width, &row[0]);
+    uint64_t *out = &bits[y * words];
+    for (int x=0; x<width; x++)
+      if (row[x])
+        out[x >> 6] |= (uint64_t)1 << (x & 63);
+  }
+}
+
+bool masksCollide(const SolidMask& a, int ax, int ay, const SolidMask& b, int bx, int by)
+{
+  /* b's offset from a, in whole tiles plus a remainder in pixels. With a
+   * remainder, each tile of a straddles two columns (or rows) of b. */
+  int dx = bx - ax, dy = by - ay;
+  int q = floorDiv(dx, TILESIZE), rx = dx - q * TILESIZE;
+  int p = floorDiv(dy, TILESIZE), ry = dy - p * TILESIZE;
+
+  int y0 = max(0, p);
+  int y1 = min(a.height, p + b.height + (ry ? 1 : 0));
+  int x0 = max(0, q);
+  int x1 = min(a.width, q + b.width + (rx ? 1 : 0));
+  if (x0 >= x1 || y0 >= y1)
+    return false;
+
+  for (int y = y0; y < y1; y++)
+  for (int w = x0 >> 6; w <= (x1 - 1) >> 6; w++)
+  {
+    uint64_t mine = a.bits[w + y * a.words];
+    if (!mine)
+      continue;
+
+    /* Columns of b under bits 64w.. of a, from b's row (or rows) under a's */
+    int bcol = (w << 6) - q;
+    uint64_t theirs = b.get(bcol, y - p);
+    if (rx)
+      theirs |= b.get(bcol - 1, y - p);
+    if (ry)
+    {
+      theirs |= b.get(bcol, y - p - 1);
+      if (rx)
+        theirs |= b.get(bcol - 1, y - p - 1);
+    }
+    if (mine & theirs)
+      return true;
+  }
+  return false;
+}
+
+/* Orders box indices by left edge, and then by index */
+struct LeftEdge {
+  const vector<int>& x;
+  LeftEdge(const vector<int>& x_) : x(x_) {}
+  bool operator()(int a, int b) const { return x[a] < x[b] || (x[a] == x[b] && a < b); }
+};
+
+void SweepAndPrune::pairs(const vector<int>& x, const vector<int>& y,
+                          const vector<int>& w, const vector<int>& h,
+                          vector<pair<int, int> >& out)
+{
+  out.clear();
+  int n = x.size();
+  if ((int)order.size() != n)
+  {
+    /* A new set of boxes, in no particular order */
+    order.resize(n);
+    for (int i=0; i<n; i++)
+      order[i] = i;
+    sort(order.begin(), order.end(), LeftEdge(x));
+  }
+  else
+  {
+    /* Insertion sort by left edge, fast on last step's nearly sorted order */
+    for (int i=1; i<n; i++)
+    {
+      int v = order[i];
+      int j = i;
+      for (; j > 0 && x[order[j-1]] > x[v]; j--)
+        order[j] = order[j-1];
+      order[j] = v;
+    }
+  }
+
+  active.clear();
+  for (int k=0; k<n; k++)
+  {
+    int i = order[k];
+
+    /* Boxes ending left of this one can't overlap it or anything after it */
+    size_t kept = 0;
+    for (size_t a=0; a<active.size(); a++)
+      if (x[active[a]] + w[active[a]] > x[i])
+        active[kept++] = active[a];
+    active.resize(kept);
+
+    for (size_t a=0; a<active.size(); a++)
+    {
+      int j = active[a];
+      if (y[j] < y[i] + h[i] && y[i] < y[j] + h[j])
+        out.push_back(make_pair(min(i, j), max(i, j)));
+    }
+    active.push_back(i);
+  }
+}
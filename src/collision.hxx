@@ -0,0 +1,72 @@
+#ifndef COLLISION_HXX
+#define COLLISION_HXX
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+struct TileRaft;
+
+/* Collision detection between rafts
+ *
+ * The broad phase, SweepAndPrune, finds the pairs of rafts whose bounding
+ * boxes overlap. The narrow phase then compares the rafts' SolidMasks, a bit
+ * per tile, to see whether any non-blank tiles of the two actually overlap.
+ * Positions are in world pixels; rafts needn't be aligned to each other's
+ * tile grid.
+ */
+
+/* One bit per tile, set for tiles other than 0, 64 tiles to a word */
+struct SolidMask {
+  int width;
+  int height;
+  int words;
+  std::vector<uint64_t> bits;
+
+  /* TileRaft :: revision of the raft as the mask was built from it */
+  unsigned long long revision;
+
+  SolidMask() : width(0), height(0), words(0), revision(0) {}
+
+  /* Rebuild the mask if raft has changed since it was last built */
+  void update(const TileRaft& raft);
+
+  /* Bits for the 64 tiles of row y starting at column x, column x in bit 0.
+   * Tiles outside the raft are clear. */
+  uint64_t get(int x, int y) const
+  {
+    if (y < 0 || y >= height)
+      return 0;
+    int w = x >> 6;
+    int s = x & 63;
+    uint64_t lo = word(w, y) >> s;
+    return s ? lo | word(w + 1, y) << (64 - s) : lo;
+  }
+
+private:
+  uint64_t word(int w, int y) const
+  {
+    return w >= 0 && w < words ? bits[w + y * words] : 0;
+  }
+};
+
+/* True if a solid tile of a, with its top left corner at (ax, ay), overlaps
+ * a solid tile of b at (bx, by) */
+bool masksCollide(const SolidMask& a, int ax, int ay, const SolidMask& b, int bx, int by);
+
+/* Sweep and prune along x. The sorted order is kept from one call to the
+ * next, so when boxes move a little each step, re-sorting is nearly linear.
+ * It is sorted from scratch when the number of boxes changes or after
+ * reset(). */
+struct SweepAndPrune {
+  /* Pairs (i, j), i < j, of the boxes x[i], y[i], w[i], h[i] that overlap */
+  void pairs(const std::vector<int>& x, const std::vector<int>& y,
+             const std::vector<int>& w, const std::vector<int>& h,
+             std::vector<std::pair<int, int> >& out);
+  /* Forget the sorted order, for when the boxes have all been replaced */
+  void reset() { order.clear(); }
+
+private:
+  std::vector<int> order;
+  std::vector<int> active;
+};
+#endif
@@ -0,0 +1,21 @@
+#include "oglconsole.h"
+#include "console.hxx"
+#include <stdarg.h>
+#include <stdio.h>
+
+bool consoleReady = false;
+
+void conPrint(const char *fmt, ...)
+{
+  va_list ap;
+  va_start(ap, fmt);
+  if (consoleReady)
+  {
+    char buf[1024];
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    OGLCONSOLE_Print("%s", buf);
+  }
+  else
+    vprintf(fmt, ap);
+  va_end(ap);
+}
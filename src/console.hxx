@@ -0,0 +1,13 @@
+#ifndef CONSOLE_HXX
+#define CONSOLE_HXX
+
+/* Set once OGLCONSOLE_Create() has been called */
+extern bool consoleReady;
+
+/* Print to the console, or to stdout when there isn't one (headless runs) */
+void conPrint(const char *fmt, ...)
+#ifdef __GNUC__
+  __attribute__((format(printf, 1, 2)))
+#endif
+  ;
+#endif
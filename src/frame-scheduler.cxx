@@ -0,0 +1,105 @@
+#include "frame-scheduler.hxx"
+#include <math.h>
+
+FrameScheduler::FrameScheduler(double tickRate_, double frameRate_, int maxCatchUp_) :
+  tickRate(tickRate_),
+  frameRate(frameRate_),
+  maxCatchUp(maxCatchUp_)
+{
+  resetStats();
+  reset(0);
+}
+
+void FrameScheduler::reset(double now)
+{
+  nextTick = now;
+  nextFrame = now;
+  catchUp = 0;
+}
+
+void FrameScheduler::resetStats()
+{
+  ticks = 0;
+  droppedTicks = 0;
+  frames = 0;
+  skippedFrames = 0;
+  tickLateness = 0;
+  maxTickLateness = 0;
+}
+
+void FrameScheduler::setTickRate(double rate)
+{
+  if (rate > 0)
+    tickRate = rate;
+}
+
+void FrameScheduler::setFrameRate(double rate)
+{
+  if (rate >= 0)
+    frameRate = rate;
+}
+
+bool FrameScheduler::tickDue(double now)
+{
+  double period = 1.0 / tickRate;
+
+  if (now < nextTick)
+  {
+    catchUp = 0;
+    return false;
+  }
+
+  if (catchUp >= maxCatchUp)
+  {
+    /* Too far behind: forget the backlog instead of trying to run it all */
+    unsigned long behind = (unsigned long)floor((now - nextTick) / period) + 1;
+    droppedTicks += behind;
+    nextTick += behind * period;
+    catchUp = 0;
+    return false;
+  }
+
+  tickLateness = now - nextTick;
+  if (tickLateness > maxTickLateness)
+    maxTickLateness = tickLateness;
+  nextTick += period;
+  catchUp++;
+  ticks++;
+  return true;
+}
+
+bool FrameScheduler::frameDue(double now)
+{
+  if (frameRate <= 0)
+  {
+    frames++;
+    return true;
+  }
+
+  if (now < nextFrame)
+    return false;
+
+  /* Count the frame slots we missed entirely, and don't try to make them up */
+  double period = 1.0 / frameRate;
+  unsigned long missed = (unsigned long)floor((now - nextFrame) / period);
+  skippedFrames += missed;
+  nextFrame += (missed + 1) * period;
+  frames++;
+  return true;
+}
+
+double FrameScheduler::alpha(double now) const
+{
+  double a = 1 - (nextTick - now) * tickRate;
+  return a < 0 ? 0 : a > 1 ? 1 : a;
+}
+
+double FrameScheduler::idleTime(double now) const
+{
+  double next = nextTick;
+  if (frameRate > 0 && nextFrame < next)
+    next = nextFrame;
+  if (frameRate <= 0)
+    return 0;
+  return next > now ? next - now : 0;
+}
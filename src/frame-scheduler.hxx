@@ -0,0 +1,58 @@
+#ifndef FRAME_SCHEDULER_HXX
+#define FRAME_SCHEDULER_HXX
+
+/* Decides when the main loop should step the simulation and when it should
+ * render. Ticks run at a fixed rate, independent of rendering; when the loop
+ * falls behind, up to maxCatchUp ticks are run back to back and any further
+ * backlog is dropped rather than letting the game spiral. Frames are drawn at
+ * most frameRate times per second (or as often as possible if it is 0), with
+ * an interpolation factor saying how far between two ticks the frame falls.
+ *
+ * Usage, once per pass through the main loop:
+ *
+ *   double now = timerSeconds();
+ *   while (sched.tickDue(now)) Game :: Step();
+ *   if (sched.frameDue(now)) { Game :: Draw(sched.alpha(now)); ... }
+ *   timerSleep(sched.idleTime(timerSeconds()));
+ */
+struct FrameScheduler {
+  double tickRate;
+  double frameRate;
+  int maxCatchUp;
+
+  /* Statistics */
+  unsigned long ticks;
+  unsigned long droppedTicks;
+  unsigned long frames;
+  unsigned long skippedFrames;
+  /* How long after its due time the last tick ran, and the worst ever */
+  double tickLateness;
+  double maxTickLateness;
+
+  FrameScheduler(double tickRate_, double frameRate_, int maxCatchUp_=5);
+
+  /* (Re)start the schedule now, e.g. after a long stall such as loading */
+  void reset(double now);
+
+  /* True if a tick should run now; call repeatedly until it returns false */
+  bool tickDue(double now);
+
+  /* True if a frame should be drawn now */
+  bool frameDue(double now);
+
+  /* Fraction of a tick that has elapsed since the last one, in [0,1] */
+  double alpha(double now) const;
+
+  /* How long the loop may sleep before the next tick or frame is due */
+  double idleTime(double now) const;
+
+  void setTickRate(double rate);
+  void setFrameRate(double rate);
+  void resetStats();
+
+private:
+  double nextTick;
+  double nextFrame;
+  int catchUp;
+};
+#endif
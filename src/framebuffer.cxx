@@ -0,0 +1,121 @@
+#include "framebuffer.hxx"
+#include "log.hxx"
+#include <SDL.h>
+#include <string.h>
+#include <string>
+
+#ifndef APIENTRY
+#  define APIENTRY
+#endif
+
+/* The same values in every version of the extension */
+#define FB_FRAMEBUFFER 0x8D40
+#define FB_COLOR_ATTACHMENT0 0x8CE0
+#define FB_FRAMEBUFFER_COMPLETE 0x8CD5
+
+typedef void (APIENTRY *GenFramebuffers)(GLsizei n, GLuint *framebuffers);
+typedef void (APIENTRY *BindFramebuffer)(GLenum target, GLuint framebuffer);
+typedef void (APIENTRY *FramebufferTexture2D)(GLenum target, GLenum attachment,
+                                              GLenum textarget, GLuint texture, GLint level);
+typedef GLenum (APIENTRY *CheckFramebufferStatus)(GLenum target);
+typedef void (APIENTRY *GenerateMipmap)(GLenum target);
+
+static GenFramebuffers genFramebuffers;
+static BindFramebuffer bindFramebuffer;
+static FramebufferTexture2D framebufferTexture2D;
+static CheckFramebufferStatus checkFramebufferStatus;
+static GenerateMipmap generateMipmap;
+
+/* The one framebuffer object, which textures are attached to in turn */
+static GLuint framebuffer;
+/* -1 until looked up */
+static int available = -1;
+
+static bool hasExtension(const char *name)
+{
+  const char *all = (const char*)glGetString(GL_EXTENSIONS);
+  size_t n = strlen(name);
+  for (const char *p = all; p && (p = strstr(p, name)); p += n)
+    if ((p == all || p[-1] == ' ') && (p[n] == ' ' || p[n] == '\0'))
+      return true;
+  return false;
+}
+
+static void *lookup(const char *name, const char *suffix)
+{
+  std::string full = name;
+  full += suffix;
+  return SDL_GL_GetProcAddress(full.c_str());
+}
+
+/* Look the calls up, and check that a texture like the ones callers draw
+ * into makes a complete framebuffer */
+static bool init()
+{
+  const char *suffix;
+  if (hasExtension("GL_ARB_framebuffer_object"))
+    suffix = "";
+  else if (hasExtension("GL_EXT_framebuffer_object"))
+    suffix = "EXT";
+  else
+  {
+    LOGI(LOG_RENDER, "no framebuffer objects; drawing offscreen is disabled\n");
+    return false;
+  }
+
+  genFramebuffers = (GenFramebuffers)lookup("glGenFramebuffers", suffix);
+  bindFramebuffer = (BindFramebuffer)lookup("glBindFramebuffer", suffix);
+  framebufferTexture2D = (FramebufferTexture2D)lookup("glFramebufferTexture2D", suffix);
+  checkFramebufferStatus = (CheckFramebufferStatus)lookup("glCheckFramebufferStatus", suffix);
+  generateMipmap = (GenerateMipmap)lookup("glGenerateMipmap", suffix);
+  if (!genFramebuffers || !bindFramebuffer || !framebufferTexture2D
+  ||  !checkFramebufferStatus || !generateMipmap)
+  {
+    LOGW(LOG_RENDER, "framebuffer object calls missing; drawing offscreen is disabled\n");
+    return false;
+  }
+
+  GLint bound;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &bound);
+  GLuint texture;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 64, 64, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+  glBindTexture(GL_TEXTURE_2D, bound);
+
+  genFramebuffers(1, &framebuffer);
+  framebufferBegin(texture);
+  GLenum status = checkFramebufferStatus(FB_FRAMEBUFFER);
+  framebufferEnd();
+  glDeleteTextures(1, &texture);
+  if (status != FB_FRAMEBUFFER_COMPLETE)
+  {
+    LOGW(LOG_RENDER, "framebuffer incomplete (0x%x); drawing offscreen is disabled\n", status);
+    return false;
+  }
+  return true;
+}
+
+bool framebufferAvailable()
+{
+  if (available < 0)
+    available = init();
+  return available;
+}
+
+void framebufferBegin(GLuint texture)
+{
+  bindFramebuffer(FB_FRAMEBUFFER, framebuffer);
+  framebufferTexture2D(FB_FRAMEBUFFER, FB_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+}
+
+void framebufferEnd()
+{
+  bindFramebuffer(FB_FRAMEBUFFER, 0);
+}
+
+void framebufferMipmaps()
+{
+  generateMipmap(GL_TEXTURE_2D);
+}
@@ -0,0 +1,31 @@
+#ifndef FRAMEBUFFER_HXX
+#define FRAMEBUFFER_HXX
+#ifdef __MACH__
+#  include <OpenGL/gl.h>
+#else
+#  include <GL/gl.h>
+#endif
+
+/* Drawing into textures through a framebuffer object
+ *
+ * The game only links against OpenGL 1.1, so the calls of
+ * EXT_framebuffer_object, which ARB_framebuffer_object and OpenGL 3.0 took
+ * over unchanged, are looked up at run time. Without them nothing can be
+ * drawn offscreen, and callers have to make do with copying what they drew
+ * out of the back buffer.
+ */
+
+/* True if framebuffer objects work in the current GL context. They are
+ * looked up the first time this is called, which must be with the context
+ * current. */
+bool framebufferAvailable();
+
+/* Direct drawing into level 0 of texture, an RGBA texture, until
+ * framebufferEnd() puts it back to the window. Only call these if
+ * framebufferAvailable(). */
+void framebufferBegin(GLuint texture);
+void framebufferEnd();
+
+/* Rebuild the mipmaps of the bound texture from its level 0 */
+void framebufferMipmaps();
+#endif
@@ -0,0 +1,398 @@
+#include "gl-renderer.hxx"
+#include "tile-raft.hxx"
+#include "glerror.hxx"
+#include "framebuffer.hxx"
+#include "profiler.hxx"
+#include "atlas.hxx"
+#include "log.hxx"
+#include "job-pool.hxx"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+GLRenderer glRenderer;
+Renderer *renderer = &glRenderer;
+
+/* Mesh of a chunk full of tile 0, used to draw chunks that were never
+ * allocated */
+static const TileMesh& blankMesh()
+{
+  static TileMesh mesh;
+  if (mesh.width == 0)
+  {
+    unsigned char zeros[CHUNKSIZE*CHUNKSIZE];
+    memset(zeros, 0, sizeof(zeros));
+    mesh.build(zeros, CHUNKSIZE, CHUNKSIZE);
+  }
+  return mesh;
+}
+
+GLRenderer::GLRenderer() :
+  texture(0),
+  batched(true),
+  cached(true),
+  frameWidth(0),
+  frameHeight(0),
+  zoom(1),
+  frames(0),
+  bound(0)
+{
+  for (int i=0; i<256; i++)
+    tileColor[i] = 0;
+}
+
+void GLRenderer::uploadAtlas(const Atlas& atlas)
+{
+  if (!texture)
+  {
+    glGenTextures(1, &texture);
+    {int err=glGetError();if(err)LOGE(LOG_RENDER, "glGenTextures() error: %i\n",err);}
+  }
+
+  glBindTexture(GL_TEXTURE_2D, texture);
+  {int err=glGetError();if(err)LOGE(LOG_RENDER, "glBindTexture() error: %i\n",err);}
+
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+      atlas.levels > 1 ? GL_NEAREST_MIPMAP_NEAREST : GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+  /* The atlas is stored ready for upload: RGBA, tightly packed rows */
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  for (int i=0; i<atlas.levels; i++)
+  {
+    int w = atlas.width >> i ? atlas.width >> i : 1;
+    int h = atlas.height >> i ? atlas.height >> i : 1;
+    glTexImage2D(
+            GL_TEXTURE_2D, i, GL_RGBA,
+            w, h, 0,
+            GL_RGBA, GL_UNSIGNED_BYTE, atlas.level[i]);
+  }
+
+  tileColors(atlas.level[0], atlas.width, atlas.height, tileColor);
+  overviews.clear();
+}
+
+void GLRenderer::beginFrame(int width, int height, float zoom_)
+{
+  frameWidth = width;
+  frameHeight = height;
+  zoom = zoom_;
+
+  // Configure the GL
+  glPushAttrib(GL_ALL_ATTRIB_BITS);
+  glDisable(GL_BLEND);
+  glEnable(GL_TEXTURE_2D);
+  glBindTexture(GL_TEXTURE_2D, bound = texture);
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glOrtho(0, width, height, 0, 1, -1);
+  glScalef(zoom, zoom, 1);
+  glColor3d(1,1,1);
+}
+
+void GLRenderer::endFrame()
+{
+  // Relinquish the GL
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glMatrixMode(GL_MODELVIEW);
+  glPopMatrix();
+  glPopAttrib();
+
+  /* Forget the overviews of rafts that have gone out of sight, or away */
+  if (++frames % 64 == 0)
+  {
+    std::map<const TileRaft*, RaftTexture>::iterator i = raftTextures.begin();
+    while (i != raftTextures.end())
+    {
+      if (frames - i->second.lastFrame > 64)
+      {
+        glDeleteTextures(1, &i->second.texture);
+        raftTextures.erase(i++);
+      }
+      else
+        ++i;
+    }
+  }
+
+  static unsigned int err=0;
+  {
+    PERF_SCOPE(PERF_GLERROR);
+    glError(NULL, &err);
+  }
+}
+
+void GLRenderer::drawChunk(TileChunk *chunk, float x, float y, int x0, int y0, int x1, int y1)
+{
+  bindAtlas();
+  if (!batched)
+  {
+    /* The old path: eight GL calls per tile */
+    glBegin(GL_QUADS);
+    for (int ty=y0; ty<y1; ty++)
+    for (int tx=x0; tx<x1; tx++)
+      ::drawTile(x + tx * TILESIZE, y + ty * TILESIZE, chunk ? chunk->tiles[tx + ty*CHUNKSIZE] : 0);
+    glEnd();
+    return;
+  }
+
+  const TileMesh *mesh = &blankMesh();
+  if (chunk)
+  {
+    if (chunk->meshRevision != chunk->revision)
+    {
+      chunk->mesh.build(chunk->tiles, CHUNKSIZE, CHUNKSIZE);
+      chunk->meshRevision = chunk->revision;
+    }
+    mesh = &chunk->mesh;
+  }
+  /* Without framebuffer objects, pieces are captured from the screen, so
+   * only at zoom 1 */
+  if (cached && (zoom == 1 || framebufferAvailable()))
+    drawCached(chunk, *mesh, x, y, x0, y0, x1, y1);
+  else
+    mesh->draw(x, y, x0, y0, x1, y1);
+}
+
+static void buildMeshes(void *data, int begin, int end)
+{
+  TileChunk **chunks = (TileChunk**)data;
+  for (int i=begin; i<end; i++)
+  {
+    chunks[i]->mesh.build(chunks[i]->tiles, CHUNKSIZE, CHUNKSIZE);
+    chunks[i]->meshRevision = chunks[i]->revision;
+  }
+}
+
+void GLRenderer::prepareChunks(TileChunk *const *chunks, int n)
+{
+  if (!batched)
+    return;
+
+  /* A chunk may be listed more than once, so mark the ones found stale
+   * as they are collected */
+  static std::vector<TileChunk*> stale;
+  stale.clear();
+  for (int i=0; i<n; i++)
+  {
+    TileChunk *chunk = chunks[i];
+    if (chunk && chunk->meshRevision != chunk->revision)
+    {
+      chunk->meshRevision = chunk->revision;
+      stale.push_back(chunk);
+    }
+  }
+  if (!stale.empty())
+    parallelFor(stale.size(), 4, buildMeshes, &stale[0]);
+}
+
+/* Tiles per side of a ChunkCache piece, and pieces per side of a chunk */
+#define PIECE_TILES (CHUNKCACHE_PIECE / TILESIZE)
+#define CHUNK_PIECES (CHUNKSIZE / PIECE_TILES)
+
+void GLRenderer::drawCached(TileChunk *chunk, const TileMesh& mesh,
+                            float x, float y, int x0, int y0, int x1, int y1)
+{
+  unsigned long long id = chunkId(chunk);
+  unsigned int revision = chunkRevision(chunk);
+  bool offscreen = framebufferAvailable();
+
+  for (int py = y0 / PIECE_TILES; py <= (y1 - 1) / PIECE_TILES; py++)
+  for (int px = x0 / PIECE_TILES; px <= (x1 - 1) / PIECE_TILES; px++)
+  {
+    int piece = px + py * CHUNK_PIECES;
+    int tx0 = std::max(x0, px * PIECE_TILES);
+    int ty0 = std::max(y0, py * PIECE_TILES);
+    int tx1 = std::min(x1, (px + 1) * PIECE_TILES);
+    int ty1 = std::min(y1, (py + 1) * PIECE_TILES);
+
+    GLuint tex = cache.lookup(id, piece, revision);
+    if (!tex && offscreen)
+    {
+      /* Pieces are drawn whole, wherever they are and at any zoom */
+      tex = cache.insert(id, piece, revision);
+      if (tex)
+        drawPiece(tex, mesh, px, py);
+    }
+    if (tex)
+    {
+      /* Texture rows run bottom-up, as on the screen */
+      float u0 = (float)(tx0 - px * PIECE_TILES) / PIECE_TILES;
+      float u1 = (float)(tx1 - px * PIECE_TILES) / PIECE_TILES;
+      float v0 = 1 - (float)(ty0 - py * PIECE_TILES) / PIECE_TILES;
+      float v1 = 1 - (float)(ty1 - py * PIECE_TILES) / PIECE_TILES;
+      float sx0 = x + tx0 * TILESIZE, sy0 = y + ty0 * TILESIZE;
+      float sx1 = x + tx1 * TILESIZE, sy1 = y + ty1 * TILESIZE;
+      glBindTexture(GL_TEXTURE_2D, tex);
+      glBegin(GL_QUADS);
+      glTexCoord2f(u0, v0); glVertex2f(sx0, sy0);
+      glTexCoord2f(u1, v0); glVertex2f(sx1, sy0);
+      glTexCoord2f(u1, v1); glVertex2f(sx1, sy1);
+      glTexCoord2f(u0, v1); glVertex2f(sx0, sy1);
+      glEnd();
+      glBindTexture(GL_TEXTURE_2D, texture);
+      continue;
+    }
+
+    mesh.draw(x, y, tx0, ty0, tx1, ty1);
+
+    /* The fallback without framebuffer objects: tiles are opaque, so right
+     * after drawing a piece the screen holds exactly that piece. It can be
+     * captured if it was drawn whole, inside the frame, at zoom 1 and on
+     * pixel boundaries. Parts of the window hidden by others may not have
+     * been drawn at all, in which case this captures garbage. */
+    int sx = (int)x + px * CHUNKCACHE_PIECE;
+    int sy = (int)y + py * CHUNKCACHE_PIECE;
+    if (offscreen || zoom != 1
+    ||  tx0 != px * PIECE_TILES || tx1 != (px + 1) * PIECE_TILES
+    ||  ty0 != py * PIECE_TILES || ty1 != (py + 1) * PIECE_TILES
+    ||  x != (int)x || y != (int)y
+    ||  sx < 0 || sy < 0
+    ||  sx + CHUNKCACHE_PIECE > frameWidth || sy + CHUNKCACHE_PIECE > frameHeight)
+      continue;
+
+    tex = cache.insert(id, piece, revision);
+    if (!tex)
+      continue;
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
+        sx, frameHeight - sy - CHUNKCACHE_PIECE, CHUNKCACHE_PIECE, CHUNKCACHE_PIECE);
+    glBindTexture(GL_TEXTURE_2D, texture);
+  }
+}
+
+void GLRenderer::drawPiece(GLuint tex, const TileMesh& mesh, int px, int py)
+{
+  /* A texel per pixel at zoom 1, laid out as the piece would be on the
+   * screen, so that it looks the same as one copied from there. The cache
+   * may have left tex bound, which must not be drawn from while drawing
+   * into it. */
+  glBindTexture(GL_TEXTURE_2D, texture);
+  framebufferBegin(tex);
+  glPushAttrib(GL_VIEWPORT_BIT);
+  glViewport(0, 0, CHUNKCACHE_PIECE, CHUNKCACHE_PIECE);
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+  glLoadIdentity();
+  glOrtho(0, CHUNKCACHE_PIECE, CHUNKCACHE_PIECE, 0, 1, -1);
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glLoadIdentity();
+  mesh.draw(-px * CHUNKCACHE_PIECE, -py * CHUNKCACHE_PIECE, px * PIECE_TILES, py * PIECE_TILES,
+      (px + 1) * PIECE_TILES, (py + 1) * PIECE_TILES);
+  glPopMatrix();
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glMatrixMode(GL_MODELVIEW);
+  glPopAttrib();
+  framebufferEnd();
+
+  /* Mipmapped like the tile set, for drawing the piece zoomed out */
+  glBindTexture(GL_TEXTURE_2D, tex);
+  framebufferMipmaps();
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+  glBindTexture(GL_TEXTURE_2D, texture);
+}
+
+void GLRenderer::drawChunkOverview(TileChunk *chunk, float x, float y, int w, int h)
+{
+  float x1 = x + w * TILESIZE, y1 = y + h * TILESIZE;
+  float u, v;
+  GLuint page = overviews.lookup(chunk, tileColor, u, v);
+  if (!page)
+  {
+    /* No room in the cache, so a flat quad will have to do */
+    uint32_t color = chunkColor(chunk, tileColor);
+    glDisable(GL_TEXTURE_2D);
+    glColor4ubv((const GLubyte*)&color);
+    glRectf(x, y, x1, y1);
+    glColor3d(1,1,1);
+    glEnable(GL_TEXTURE_2D);
+    return;
+  }
+
+  float u1 = u + (float)w / OVERVIEW_PAGE, v1 = v + (float)h / OVERVIEW_PAGE;
+  if (bound != page)
+    glBindTexture(GL_TEXTURE_2D, bound = page);
+  glBegin(GL_QUADS);
+  glTexCoord2f(u, v);   glVertex2f(x, y);
+  glTexCoord2f(u1, v);  glVertex2f(x1, y);
+  glTexCoord2f(u1, v1); glVertex2f(x1, y1);
+  glTexCoord2f(u, v1);  glVertex2f(x, y1);
+  glEnd();
+}
+
+/* Largest raft overview texture, in texels a side */
+#define RAFT_OVERVIEW_MAX 256
+
+static int pow2(int n)
+{
+  int p = 1;
+  while (p < n)
+    p *= 2;
+  return p;
+}
+
+void GLRenderer::drawRaftOverview(TileRaft *raft, float x, float y)
+{
+  if (raft->chunks.empty())
+    return;
+  bindAtlas();
+
+  RaftTexture& t = raftTextures[raft];
+  if (!t.texture || t.revision != raft->revision)
+  {
+    static std::vector<uint32_t> texels;
+    t.step = raftOverview(*raft, tileColor, RAFT_OVERVIEW_MAX, t.width, t.height, texels);
+    if (!t.texture)
+    {
+      glGenTextures(1, &t.texture);
+      t.texWidth = t.texHeight = 0;
+    }
+    glBindTexture(GL_TEXTURE_2D, t.texture);
+    if (t.texWidth < t.width || t.texHeight < t.height)
+    {
+      /* The GL only takes power of two textures */
+      t.texWidth = pow2(t.width);
+      t.texHeight = pow2(t.height);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, t.texWidth, t.texHeight, 0,
+          GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, t.width, t.height,
+        GL_RGBA, GL_UNSIGNED_BYTE, &texels[0]);
+    t.revision = raft->revision;
+  }
+  else
+    glBindTexture(GL_TEXTURE_2D, t.texture);
+  t.lastFrame = frames;
+
+  /* The overview's edge texels cover whole chunks, which may run past the
+   * raft's edge, so only the part the raft covers is drawn */
+  float chunkPixels = CHUNKSIZE * TILESIZE;
+  float u1 = raft->width * TILESIZE / (chunkPixels * t.step * t.texWidth);
+  float v1 = raft->height * TILESIZE / (chunkPixels * t.step * t.texHeight);
+  float x1 = x + raft->width * TILESIZE, y1 = y + raft->height * TILESIZE;
+  glBegin(GL_QUADS);
+  glTexCoord2f(0, 0);   glVertex2f(x, y);
+  glTexCoord2f(u1, 0);  glVertex2f(x1, y);
+  glTexCoord2f(u1, v1); glVertex2f(x1, y1);
+  glTexCoord2f(0, v1);  glVertex2f(x, y1);
+  glEnd();
+  glBindTexture(GL_TEXTURE_2D, texture);
+}
+
+void GLRenderer::drawTile(float x, float y, unsigned char tile)
+{
+  bindAtlas();
+  glBegin(GL_QUADS);
+  ::drawTile(x, y, tile);
+  glEnd();
+}
@@ -0,0 +1,86 @@
+#ifndef GL_RENDERER_HXX
+#define GL_RENDERER_HXX
+#include "renderer.hxx"
+#include "tile-mesh.hxx"
+#include "chunk-cache.hxx"
+#include "overview.hxx"
+#include <map>
+
+struct Atlas;
+
+struct GLRenderer : Renderer {
+  /* Texture holding the tile set */
+  GLuint texture;
+
+  /* When true, chunks are drawn from their TileMesh with one glDrawArrays()
+   * call per chunk; when false, every tile goes through drawTile() (see
+   * Game :: BenchDraw()) */
+  bool batched;
+
+  /* When true (and batched), chunks are drawn from textures in cache
+   * wherever possible */
+  bool cached;
+  ChunkCache cache;
+
+  /* Average color of each tile, worked out by uploadAtlas(), and chunk
+   * overviews drawn with them */
+  uint32_t tileColor[256];
+  OverviewCache overviews;
+
+  /* Size of the frame being drawn, as passed to beginFrame() */
+  int frameWidth;
+  int frameHeight;
+  float zoom;
+  unsigned long frames;
+
+  GLRenderer();
+
+  /* Upload every mip level of the tile set to texture, creating it first if
+   * need be */
+  void uploadAtlas(const Atlas& atlas);
+
+  void beginFrame(int width, int height, float zoom);
+  void endFrame();
+  void drawChunk(TileChunk *chunk, float x, float y, int x0, int y0, int x1, int y1);
+  /* Rebuild the meshes of any chunks that have changed, on the job pool */
+  void prepareChunks(TileChunk *const *chunks, int n);
+  void drawChunkOverview(TileChunk *chunk, float x, float y, int w, int h);
+  void drawRaftOverview(TileRaft *raft, float x, float y);
+  void drawTile(float x, float y, unsigned char tile);
+
+private:
+  /* Raft overviews, each in a texture of its own, rebuilt whenever the
+   * raft's revision changes and deleted once the raft hasn't been drawn for
+   * a while */
+  struct RaftTexture {
+    GLuint texture;
+    /* Texels used, and the texture's size */
+    int width;
+    int height;
+    int texWidth;
+    int texHeight;
+    /* Chunks a side per texel */
+    int step;
+    unsigned long long revision;
+    unsigned long lastFrame;
+  };
+  std::map<const TileRaft*, RaftTexture> raftTextures;
+
+  /* The texture bound, which is texture except after drawChunkOverview(),
+   * so that a run of overviews from one page binds it just once */
+  GLuint bound;
+  void bindAtlas()
+  {
+    if (bound != texture)
+      glBindTexture(GL_TEXTURE_2D, bound = texture);
+  }
+
+  void drawCached(TileChunk *chunk, const TileMesh& mesh,
+                  float x, float y, int x0, int y0, int x1, int y1);
+  /* Draw piece (px, py) of a chunk into texture tex, through a framebuffer
+   * object */
+  void drawPiece(GLuint tex, const TileMesh& mesh, int px, int py);
+};
+
+extern GLRenderer glRenderer;
+#endif
@@ -0,0 +1,261 @@
+#include "input-log.hxx"
+#include "log.hxx"
+#include <stdio.h>
+#include <string.h>
+using namespace std;
+
+static FILE *recordFile;
+/* Records are built here and written out a few KiB at a time */
+static vector<unsigned char> pending;
+
+static void flush()
+{
+  if (!pending.empty())
+    fwrite(&pending[0], 1, pending.size(), recordFile);
+  pending.clear();
+}
+
+static void putVarint(uint32_t v)
+{
+  while (v >= 0x80)
+  {
+    pending.push_back(v | 0x80);
+    v >>= 7;
+  }
+  pending.push_back(v);
+}
+
+static void putSigned(int v)
+{
+  putVarint((uint32_t)v << 1 ^ (uint32_t)(v >> 31));
+}
+
+static void begin(int type)
+{
+  if (pending.size() >= 4096)
+    flush();
+  pending.push_back(type);
+}
+
+bool recordStart(const char *filename, uint32_t seed, int width, int height, double tickRate)
+{
+  if (recordFile)
+    recordStop(0);
+  recordFile = fopen(filename, "wb");
+  if (!recordFile)
+  {
+    LOGE(LOG_INPUT, "could not record to \"%s\"\n", filename);
+    return false;
+  }
+
+  InputLogHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, INPUTLOG_MAGIC, sizeof(h.magic));
+  h.version = INPUTLOG_VERSION;
+  h.seed = seed;
+  h.width = width;
+  h.height = height;
+  h.tickRate = tickRate;
+  fwrite(&h, sizeof(h), 1, recordFile);
+  LOGI(LOG_INPUT, "recording input to \"%s\"\n", filename);
+  return true;
+}
+
+void recordStop(uint32_t checksum)
+{
+  if (!recordFile)
+    return;
+  begin(INPUT_END);
+  putVarint(checksum);
+  flush();
+  if (fclose(recordFile) != 0)
+    LOGE(LOG_INPUT, "error writing input log\n");
+  recordFile = NULL;
+}
+
+bool recording()
+{
+  return recordFile != NULL;
+}
+
+void recordMouse(int x, int y)
+{
+  if (!recordFile)
+    return;
+  begin(INPUT_MOUSE);
+  putSigned(x);
+  putSigned(y);
+}
+
+void recordButton(int button, bool down)
+{
+  if (!recordFile)
+    return;
+  begin(INPUT_BUTTON);
+  putVarint(button);
+  putVarint(down);
+}
+
+void recordKey(int key, bool down)
+{
+  if (!recordFile)
+    return;
+  begin(INPUT_KEY);
+  putVarint(key);
+  putVarint(down);
+}
+
+void recordCommand(const char *line)
+{
+  if (!recordFile)
+    return;
+  size_t len = strlen(line);
+  begin(INPUT_COMMAND);
+  putVarint(len);
+  pending.insert(pending.end(), line, line + len);
+}
+
+void recordResize(int width, int height)
+{
+  if (!recordFile)
+    return;
+  begin(INPUT_RESIZE);
+  putVarint(width);
+  putVarint(height);
+}
+
+void recordSteps(int n)
+{
+  if (!recordFile || n <= 0)
+    return;
+  begin(INPUT_STEPS);
+  putVarint(n);
+}
+
+void recordFrame(double alpha, double seconds)
+{
+  if (!recordFile)
+    return;
+  float a = alpha;
+  uint32_t bits;
+  memcpy(&bits, &a, sizeof(bits));
+  begin(INPUT_FRAME);
+  putVarint(bits);
+  putVarint(seconds > 0 ? (uint32_t)(seconds * 1e6 + 0.5) : 0);
+}
+
+bool InputLogReader::open(const char *filename)
+{
+  data.clear();
+  pos = 0;
+  ended = false;
+  checksum = 0;
+
+  FILE *f = fopen(filename, "rb");
+  if (!f)
+  {
+    LOGE(LOG_INPUT, "could not open \"%s\"\n", filename);
+    return false;
+  }
+  unsigned char buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    data.insert(data.end(), buf, buf + n);
+  fclose(f);
+
+  if (data.size() < sizeof(header))
+  {
+    LOGE(LOG_INPUT, "\"%s\" is not an input log\n", filename);
+    return false;
+  }
+  memcpy(&header, &data[0], sizeof(header));
+  if (memcmp(header.magic, INPUTLOG_MAGIC, sizeof(header.magic)) != 0)
+  {
+    LOGE(LOG_INPUT, "\"%s\" is not an input log\n", filename);
+    return false;
+  }
+  if (header.version != INPUTLOG_VERSION)
+  {
+    LOGE(LOG_INPUT, "\"%s\" is version %u of the input log format; only %d is understood\n",
+        filename, (unsigned int)header.version, INPUTLOG_VERSION);
+    return false;
+  }
+  pos = sizeof(header);
+  return true;
+}
+
+bool InputLogReader::readVarint(uint32_t& v)
+{
+  v = 0;
+  for (int shift=0; shift<35; shift+=7)
+  {
+    if (pos >= data.size())
+      return false;
+    unsigned char b = data[pos++];
+    v |= (uint32_t)(b & 0x7f) << shift;
+    if (!(b & 0x80))
+      return true;
+  }
+  return false;
+}
+
+bool InputLogReader::readSigned(int& v)
+{
+  uint32_t u;
+  if (!readVarint(u))
+    return false;
+  v = (int)(u >> 1 ^ -(u & 1));
+  return true;
+}
+
+bool InputLogReader::next(InputEvent& e)
+{
+  if (ended || pos >= data.size())
+    return false;
+
+  size_t start = pos;
+  e.type = data[pos++];
+  e.a = e.b = 0;
+  e.line.clear();
+
+  uint32_t a = 0, b = 0;
+  bool ok;
+  switch (e.type)
+  {
+    case INPUT_MOUSE:
+      ok = readSigned(e.a) && readSigned(e.b);
+      break;
+    case INPUT_BUTTON:
+    case INPUT_KEY:
+    case INPUT_RESIZE:
+    case INPUT_FRAME:
+      ok = readVarint(a) && readVarint(b);
+      e.a = a;
+      e.b = b;
+      break;
+    case INPUT_STEPS:
+      ok = readVarint(a);
+      e.a = a;
+      break;
+    case INPUT_COMMAND:
+      ok = readVarint(a) && a <= data.size() - pos;
+      if (ok)
+      {
+        e.line.assign((const char*)&data[pos], a);
+        pos += a;
+      }
+      break;
+    case INPUT_END:
+      ok = ended = readVarint(checksum);
+      break;
+    default:
+      ok = false;
+  }
+
+  if (!ok)
+  {
+    LOGW(LOG_INPUT, "input log: bad or cut short record at byte %lu\n", (unsigned long)start);
+    pos = data.size();
+  }
+  return ok && !ended;
+}
@@ -0,0 +1,103 @@
+#ifndef INPUT_LOG_HXX
+#define INPUT_LOG_HXX
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/* Input recording and replay
+ *
+ * The game only changes in response to what the main loop feeds it: mouse
+ * moves and buttons, keys, console commands, and Game :: Step(). With the
+ * same random seed and the same calls in the same order, it ends up in the
+ * same state, so recording those calls is enough to play a session back.
+ *
+ * An input log starts with an InputLogHeader, followed by records, each a
+ * type byte and its fields as LEB128 varints (signed ones zigzagged), so
+ * that a few minutes of play takes kilobytes:
+ *
+ *   INPUT_MOUSE    x y              Game :: Mouse()
+ *   INPUT_BUTTON   button down      Game :: MouseButton()
+ *   INPUT_KEY      key down         Game :: Key()
+ *   INPUT_COMMAND  length bytes     a console command line
+ *   INPUT_RESIZE   width height     the window was resized
+ *   INPUT_STEPS    n                n calls to Game :: Step()
+ *   INPUT_FRAME    alpha micros     a frame drawn at alpha (the bits of a
+ *                                   float), and the microseconds the pass
+ *                                   of the main loop ending in it took
+ *   INPUT_END      checksum         Game :: Checksum() when recording stopped
+ *
+ * A log cut short, by a crash say, plays back up to where it stops.
+ */
+#define INPUTLOG_MAGIC "LD26INPT"
+#define INPUTLOG_VERSION 1
+
+#define INPUT_MOUSE 1
+#define INPUT_BUTTON 2
+#define INPUT_KEY 3
+#define INPUT_COMMAND 4
+#define INPUT_RESIZE 5
+#define INPUT_STEPS 6
+#define INPUT_FRAME 7
+#define INPUT_END 8
+
+struct InputLogHeader {
+  char magic[8];
+  uint32_t version;
+  /* Passed to srandom() before Game :: Init() */
+  uint32_t seed;
+  int32_t width;
+  int32_t height;
+  float tickRate;
+  uint32_t reserved;
+};
+
+/* Start recording to filename, replacing whatever is there. Returns false
+ * if it can't be written. */
+bool recordStart(const char *filename, uint32_t seed, int width, int height, double tickRate);
+/* Write the end record and close the log */
+void recordStop(uint32_t checksum);
+bool recording();
+
+/* Each does nothing unless recording */
+void recordMouse(int x, int y);
+void recordButton(int button, bool down);
+void recordKey(int key, bool down);
+void recordCommand(const char *line);
+void recordResize(int width, int height);
+void recordSteps(int n);
+void recordFrame(double alpha, double seconds);
+
+struct InputEvent {
+  int type;
+  /* The record's fields, in order; for INPUT_FRAME, a is the alpha's bits
+   * and b the microseconds */
+  int a;
+  int b;
+  /* For INPUT_COMMAND */
+  std::string line;
+};
+
+/* Reads a whole input log into memory, to be played back without touching
+ * the disk */
+struct InputLogReader {
+  InputLogHeader header;
+  /* Set once the end record has been read, with the checksum in it */
+  bool ended;
+  uint32_t checksum;
+
+  InputLogReader() : ended(false), checksum(0), pos(0) {}
+
+  /* Returns false, having logged why, if filename isn't an input log */
+  bool open(const char *filename);
+  /* The next record, or false at the end of the log. Stops, with a
+   * warning, at a record it can't make sense of. */
+  bool next(InputEvent& e);
+
+private:
+  std::vector<unsigned char> data;
+  size_t pos;
+
+  bool readVarint(uint32_t& v);
+  bool readSigned(int& v);
+};
+#endif
@@ -1,11 +1,33 @@
-#include "oglconsole.h"
+#include "console.hxx"
+#include "log.hxx"
 #include "interactive-application.hxx"
+#include "world.hxx"
 #include "glerror.hxx"
+#include "tile-raft.hxx"
+#include "mapfile.hxx"
+#include "raft-grid.hxx"
+#include "profiler.hxx"
+#include "renderer.hxx"
+#include "gl-renderer.hxx"
+#include "undo.hxx"
+#include "region.hxx"
+#include "timer.hxx"
+#include "arena.hxx"
+#include "collision.hxx"
+#include "job-pool.hxx"
+#include "autosave.hxx"
+#include "camera.hxx"
+#include "overview.hxx"
+#include "pathfind.hxx"
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
 #include <SDL.h>
 #include <list>
 #include <vector>
 #include <fstream>
+#include <algorithm>
+#include <new>
 #ifdef __MACH__
 #  include <OpenGL/gl.h>
 #else
@@ -13,11 +35,7 @@
 #endif
 using namespace std;
 
-#define TILESIZE 16
-#define TILESETW 32
-#define TILESETH 32
 extern int ScreenWidth, ScreenHeight;
-extern GLuint tilesTexture;
 
 /* This number increments once with each frame the game renders */
 int frameNumber = 0;
@@ -25,212 +43,552 @@ int frameNumber = 0;
 /* This number increments with each "step" the game takes (see Game :: Step()) */
 int stepNumber = 0;
 
-/* This function can draw a tile from the tile set for map tiles or sprites */
-inline void drawTile(GLdouble vx0, GLdouble vy0, unsigned char tile)
+/* Interpolation factor between the last step and the next for the frame being
+ * drawn (see Game :: Draw()) */
+double stepAlpha = 1;
+
+/* Number of tiles sent to the GL and culled during the last World :: draw() */
+int tilesSubmitted = 0;
+int tilesSkipped = 0;
+/* Overview quads drawn instead of tiles, and the level of detail, during the
+ * last World :: draw() */
+int overviewsSubmitted = 0;
+int lastLod = LOD_TILES;
+
+/* Append the tiles on the line from (x0, y0) to (x1, y1) to out, excluding
+ * (x0, y0) itself (Bresenham) */
+static void rasterLine(int x0, int y0, int x1, int y1, vector<int>& out)
 {
-  /* Determine full boundaries of the tile or sprite's polygon */
-  GLdouble vx1 = vx0 + TILESIZE;
-  GLdouble vy1 = vy0 + TILESIZE;
-
-  /* Determine the position of the tile or sprite in the texture containing our tile set */
-  unsigned char tileX = tile%TILESETW;
-  unsigned char tileY = tile/TILESETW;
-  GLdouble tx0 = (tileX+0) / (GLdouble)TILESETW;
-  GLdouble ty0 = (tileY+0) / (GLdouble)TILESETH;
-  GLdouble tx1 = (tileX+1) / (GLdouble)TILESETW;
-  GLdouble ty1 = (tileY+1) / (GLdouble)TILESETH;
-
-  /* Send vertices to the GL */
-  glTexCoord2d(tx0, ty0);
-  glVertex2d  (vx0, vy0);
-  glTexCoord2d(tx1, ty0);
-  glVertex2d  (vx1, vy0);
-  glTexCoord2d(tx1, ty1);
-  glVertex2d  (vx1, vy1);
-  glTexCoord2d(tx0, ty1);
-  glVertex2d  (vx0, vy1);
+  int dx = abs(x1 - x0), sx = x0 < x1 ? 1 : -1;
+  int dy = -abs(y1 - y0), sy = y0 < y1 ? 1 : -1;
+  int err = dx + dy;
+  while (x0 != x1 || y0 != y1)
+  {
+    int e2 = 2 * err;
+    if (e2 >= dy) { err += dy; x0 += sx; }
+    if (e2 <= dx) { err += dx; y0 += sy; }
+    out.push_back(x0);
+    out.push_back(y0);
+  }
 }
 
-struct TileRaft;
+World::~World()
+{
+  clear();
+}
 
-struct World {
-  vector<TileRaft*> rafts;
+void World::clear()
+{
+  for (vector<TileRaft*>::iterator raft = rafts.begin(); raft != rafts.end(); ++raft)
+  {
+    /* Rafts added by hand may come from the heap */
+    if ((*raft)->arena == &arena)
+      (*raft)->~TileRaft();
+    else
+      delete *raft;
+  }
+  rafts.clear();
+  raftX.clear();
+  raftY.clear();
+  raftW.clear();
+  raftH.clear();
+  raftVX.clear();
+  raftVY.clear();
+  raftPrevX.clear();
+  maxMove = 0;
+  raftPrevY.clear();
+  sweep.reset();
+  masks.clear();
+  navs.clear();
+  grid.clear();
+  journal.clear();
+  totalTiles = 0;
+  cursorX = -1;
+  cursorY = -1;
+  cursorRaft = -1;
+  cursorPainting = false;
 
-  /* Scroll offset */
-  int xOff;
-  int yOff;
+  /* The autosaver may be reading rafts straight out of the file */
+  if (mapFile)
+    autosaveWait();
+  delete mapFile;
+  mapFile = NULL;
+  arena.reset();
+}
 
-  /* edit-mode stuff */
-  bool editMode;
-  /* current tile pos and TileRaft selected by edit cursor */
-  int cursorRaft;
-  int cursorX;
-  int cursorY;
-  static int pickedTile;
-  bool cursorPainting;
+bool World::validateCursor()
+{
+  if (cursorRaft < 0
+  || cursorRaft >= (int)rafts.size()
+  || cursorX < 0
+  || cursorY < 0)
+    return false;
+  
+  TileRaft* raft = rafts[cursorRaft];
+
+  if (cursorX >= raft->width
+  ||  cursorY >= raft->height)
+    return false;
+
+  return true;
+}
 
-  World()
+size_t World::bucketFill(int i, int x, int y, unsigned char tile, bool diagonal, BucketStack& stack)
+{
+  TileRaft& raft = *rafts[i];
+  unsigned char target = x >= 0 && y >= 0 && x < raft.width && y < raft.height ? raft.get(x, y) : 0;
+  size_t filled = regionBucketFill(raft, x, y, tile, diagonal, stack);
+  if (!filled)
+    return 0;
+
+  /* Only the filled spans changed, so the rest of their bounding box reads
+   * the same after as it did before */
+  TileRegion before;
+  regionCopy(raft, stack.x0, stack.y0, stack.x1, stack.y1, before);
+  for (size_t s=0; s<stack.changed.size(); s++)
   {
-    xOff = 0;
-    yOff = 0;
-    editMode = true;
-    cursorX = -1;
-    cursorY = -1;
-    cursorRaft = -1;
-    cursorPainting = false;
+    const BucketStack::Span& span = stack.changed[s];
+    memset(&before.tiles[span.x0 - stack.x0 + (size_t)(span.y - stack.y0) * before.width],
+        target, span.x1 - span.x0);
   }
+  journal.addRect(raft, i, stack.x0, stack.y0, stack.x1, stack.y1, &before.tiles[0]);
+  return filled;
+}
+
+int World::pickedTile = 0;
 
-  World(istream& in);
+void World::addRaft(TileRaft *raft)
+{
+  rafts.push_back(raft);
+  raftX.push_back(raft->xOff);
+  raftY.push_back(raft->yOff);
+  raftW.push_back(raft->width * TILESIZE);
+  raftH.push_back(raft->height * TILESIZE);
+  raftVX.push_back(0);
+  raftVY.push_back(0);
+  raftPrevX.push_back(raft->xOff);
+  raftPrevY.push_back(raft->yOff);
+  masks.push_back(SolidMask());
+  navs.push_back(NavGrid());
+  totalTiles += raft->width * raft->height;
+  moveRaft(rafts.size() - 1, raft->xOff, raft->yOff);
+}
 
-  ~World();
+void World::moveRaft(int i, int xOff, int yOff)
+{
+  TileRaft *raft = rafts[i];
+  raft->xOff = raftX[i] = xOff;
+  raft->yOff = raftY[i] = yOff;
+  grid.set(i, xOff, yOff, xOff + raftW[i], yOff + raftH[i]);
+}
 
-  void draw();
-  bool mouse(int x, int y);
-  bool mouseButton(int button, bool down);
-  bool validateCursor();
+void World::raftsAt(int x, int y, vector<int>& out)
+{
+  grid.queryPoint(x, y, out);
+}
 
-  friend ostream & operator<<(ostream &out, const World &);
-};
+void World::raftsIn(int x0, int y0, int x1, int y1, vector<int>& out)
+{
+  grid.queryRect(x0, y0, x1, y1, out);
+}
 
-struct TileRaft {
-  int width;
-  int height;
-  int xOff;
-  int yOff;
-  vector<unsigned char> tiles;
-
-  TileRaft(int width_, int height_) :
-    width(width_),
-    height(height_),
-    xOff(0),
-    yOff(0),
-    tiles(width_*height_)
+static void updateMasks(void *data, int begin, int end)
+{
+  World& w = *(World*)data;
+  for (int k=begin; k<end; k++)
   {
+    int i = w.maskRafts[k];
+    w.masks[i].update(*w.rafts[i]);
   }
+}
 
-  TileRaft(istream& in);
-
-  void draw(GLdouble xOff, GLdouble yOff)
+static void testPairs(void *data, int begin, int end)
+{
+  World& w = *(World*)data;
+  for (int k=begin; k<end; k++)
   {
-    glColor3d(1,1,1);
-    for (int y=0; y<height; y++)
-    for (int x=0; x<width; x++)
-      drawTile(x * TILESIZE + xOff, y * TILESIZE + yOff, tiles[y*width+x]);
+    int i = w.tests[k].first, j = w.tests[k].second;
+    w.hits[k] = masksCollide(w.masks[i], w.raftX[i], w.raftY[i], w.masks[j], w.raftX[j], w.raftY[j]);
   }
+}
 
-  friend ostream & operator<<(ostream &out, const TileRaft &);
-};
+/* True if velocity v heads along d, the way from a raft to the one it hit;
+ * if the two are level, any movement counts */
+static inline bool heading(int v, long long d)
+{
+  return d > 0 ? v > 0 : d < 0 ? v < 0 : v != 0;
+}
 
-World::~World()
+void World::step()
 {
-  for (vector<TileRaft*>::iterator raft = rafts.begin(); raft != rafts.end(); ++raft)
+  for (size_t i=0; i<rafts.size(); i++)
+  {
+    raftPrevX[i] = raftX[i];
+    raftPrevY[i] = raftY[i];
+    if (raftVX[i] || raftVY[i])
+      moveRaft(i, raftX[i] + raftVX[i], raftY[i] + raftVY[i]);
+  }
+
+  sweep.pairs(raftX, raftY, raftW, raftH, contacts);
+  lastPairs = contacts.size();
+
+  tests.clear();
+  needMask.assign(rafts.size(), false);
+  for (size_t k=0; k<contacts.size(); k++)
+  {
+    int i = contacts[k].first, j = contacts[k].second;
+    /* Two resting rafts can't have just collided */
+    if (!raftVX[i] && !raftVY[i] && !raftVX[j] && !raftVY[j])
+      continue;
+    tests.push_back(contacts[k]);
+    needMask[i] = needMask[j] = true;
+  }
+
+  /* The masks are updated and the pairs tested on the job pool. Paging a
+   * raft in allocates from the arena, so that is done here first. */
+  maskRafts.clear();
+  for (size_t i=0; i<rafts.size(); i++)
+    if (needMask[i])
+    {
+      if (rafts[i]->source)
+        rafts[i]->page();
+      maskRafts.push_back(i);
+    }
+  parallelFor(maskRafts.size(), 16, updateMasks, this);
+  hits.resize(tests.size());
+  parallelFor(tests.size(), 64, testPairs, this);
+
+  /* Collisions are acted on in pair order, however the tests were split up,
+   * so that the outcome is always the same */
+  lastCollisions = 0;
+  bounced.assign(rafts.size(), false);
+  for (size_t k=0; k<tests.size(); k++)
   {
-    delete *raft;
+    if (!hits[k])
+      continue;
+
+    int i = tests[k].first, j = tests[k].second;
+    lastCollisions++;
+
+    /* Which sides met, from where the rafts were before the step: they hit
+     * side to side if they were apart only along x, top to bottom if apart
+     * only along y, and corner to corner otherwise */
+    bool apartX = raftPrevX[i] + raftW[i] <= raftPrevX[j] || raftPrevX[j] + raftW[j] <= raftPrevX[i];
+    bool apartY = raftPrevY[i] + raftH[i] <= raftPrevY[j] || raftPrevY[j] + raftH[j] <= raftPrevY[i];
+    bool alongX = apartX || !apartY, alongY = apartY || !apartX;
+    /* From i's center to j's, doubled */
+    long long dx = 2LL * raftPrevX[j] + raftW[j] - 2LL * raftPrevX[i] - raftW[i];
+    long long dy = 2LL * raftPrevY[j] + raftH[j] - 2LL * raftPrevY[i] - raftH[i];
+
+    int n[2] = { i, j };
+    for (int m=0; m<2; m++)
+    {
+      int r = n[m];
+      long long s = m ? -1 : 1;
+      bool turnX = alongX && heading(raftVX[r], s * dx);
+      bool turnY = alongY && heading(raftVY[r], s * dy);
+      /* Only a raft heading into the other turns back, so a pair that is
+       * already separating is left to separate rather than flipping again
+       * every step. A raft hitting several others this step only turns
+       * around once. */
+      if (bounced[r] || (!turnX && !turnY))
+        continue;
+      bounced[r] = true;
+      moveRaft(r, raftPrevX[r], raftPrevY[r]);
+      if (turnX)
+        raftVX[r] = -raftVX[r];
+      if (turnY)
+        raftVY[r] = -raftVY[r];
+    }
   }
+
+  maxMove = 0;
+  for (size_t i=0; i<rafts.size(); i++)
+    maxMove = max(maxMove, max(abs(raftX[i] - raftPrevX[i]), abs(raftY[i] - raftPrevY[i])));
 }
 
-bool World::validateCursor()
+/* The on-screen tiles of a raft, from World :: draw() */
+struct DrawSpan {
+  int raft;
+  /* Position of the raft relative to the view */
+  float rx, ry;
+  /* Tile range to draw */
+  int x0, y0, x1, y1;
+};
+
+/* Clamp a world coordinate into int range, for culling far-out views */
+static inline int clampCoord(double v)
 {
-  if (cursorRaft < 0
-  || cursorRaft >= (int)rafts.size()
-  || cursorX < 0
-  || cursorY < 0)
-    return false;
-  
-  TileRaft* raft = rafts[cursorRaft];
+  return (int)max(-2147483647.0, min(2147483647.0, v));
+}
 
-  if (cursorX >= raft->width
-  ||  cursorY >= raft->height)
-    return false;
+void World::raftsDrawnAt(int x, int y, vector<int>& out)
+{
+  if (!maxMove)
+  {
+    raftsAt(x, y, out);
+    return;
+  }
 
-  return true;
+  /* No raft is drawn further than maxMove from where the grid has it */
+  raftsIn(clampCoord((double)x - maxMove), clampCoord((double)y - maxMove),
+          clampCoord((double)x + maxMove + 1), clampCoord((double)y + maxMove + 1), out);
+  size_t n = 0;
+  for (size_t k=0; k<out.size(); k++)
+  {
+    int i = out[k];
+    long long dx = (long long)x - drawX(i), dy = (long long)y - drawY(i);
+    if (dx >= 0 && dx < raftW[i] && dy >= 0 && dy < raftH[i])
+      out[n++] = i;
+  }
+  out.resize(n);
 }
 
-int World::pickedTile = 0;
-
-void World::draw()
+void World::draw(double vx, double vy, double vzoom)
 {
-  for (vector<TileRaft*>::iterator raft = rafts.begin(); raft != rafts.end(); ++raft)
+  tilesSubmitted = 0;
+  overviewsSubmitted = 0;
+  lastLod = lodForZoom(vzoom);
+
+  /* Only rafts overlapping the screen are visited at all */
+  double viewW = ScreenWidth / vzoom, viewH = ScreenHeight / vzoom;
+  static vector<int> visible;
+  raftsIn(clampCoord(floor(vx)), clampCoord(floor(vy)),
+          clampCoord(ceil(vx + viewW)), clampCoord(ceil(vy + viewH)), visible);
+
+  /* Work out what is to be drawn first, so that the renderer can prepare
+   * every chunk involved at once */
+  static vector<DrawSpan> spans;
+  static vector<TileChunk*> chunks;
+  spans.clear();
+  chunks.clear();
+  for (vector<int>::iterator i = visible.begin(); i != visible.end(); ++i)
+  {
+    /* Position of the raft relative to the view */
+    double rx = drawX(*i) - vx;
+    double ry = drawY(*i) - vy;
+
+    if (lastLod == LOD_RAFTS)
+    {
+      renderer->drawRaftOverview(rafts[*i], (float)rx, (float)ry);
+      overviewsSubmitted++;
+      continue;
+    }
+
+    /* Clamp the tile range to the part of the raft that is on-screen */
+    int x0 = (int)max(0.0, floor(-rx / TILESIZE));
+    int y0 = (int)max(0.0, floor(-ry / TILESIZE));
+    int x1 = (int)min((double)raftW[*i] / TILESIZE, ceil((viewW - rx) / TILESIZE));
+    int y1 = (int)min((double)raftH[*i] / TILESIZE, ceil((viewH - ry) / TILESIZE));
+    if (x0 >= x1 || y0 >= y1)
+      continue;
+
+    DrawSpan span = { *i, (float)rx, (float)ry, x0, y0, x1, y1 };
+    spans.push_back(span);
+    if (lastLod == LOD_TILES)
+      for (int cy = y0 / CHUNKSIZE; cy <= (y1 - 1) / CHUNKSIZE; cy++)
+      for (int cx = x0 / CHUNKSIZE; cx <= (x1 - 1) / CHUNKSIZE; cx++)
+        chunks.push_back(rafts[*i]->chunk(cx, cy));
+  }
+  if (!chunks.empty())
+    renderer->prepareChunks(&chunks[0], chunks.size());
+
+  for (size_t i=0; i<spans.size(); i++)
   {
-    (*raft)->draw(xOff, yOff);
+    const DrawSpan& s = spans[i];
+    TileRaft *raft = rafts[s.raft];
+    if (lastLod == LOD_TILES)
+    {
+      tilesSubmitted += (s.x1 - s.x0) * (s.y1 - s.y0);
+      raft->draw(renderer, s.rx, s.ry, s.x0, s.y0, s.x1, s.y1);
+      continue;
+    }
+
+    /* Whole chunks, at a quad apiece */
+    for (int cy = s.y0 / CHUNKSIZE; cy <= (s.y1 - 1) / CHUNKSIZE; cy++)
+    for (int cx = s.x0 / CHUNKSIZE; cx <= (s.x1 - 1) / CHUNKSIZE; cx++)
+    {
+      renderer->drawChunkOverview(raft->chunk(cx, cy),
+          s.rx + cx * CHUNKSIZE * TILESIZE, s.ry + cy * CHUNKSIZE * TILESIZE,
+          min(CHUNKSIZE, raft->width - cx * CHUNKSIZE),
+          min(CHUNKSIZE, raft->height - cy * CHUNKSIZE));
+      overviewsSubmitted++;
+    }
   }
+  tilesSkipped = totalTiles - tilesSubmitted;
 
   if (editMode)
   {
     /* Draw cursor if it's selecting a valid tile */
     if (cursorRaft >= 0 && cursorX >= 0 && cursorY >= 0)
     {
-      TileRaft* raft = rafts[cursorRaft];
-      drawTile(cursorX * TILESIZE + xOff + raft->xOff,
-               cursorY * TILESIZE + yOff + raft->yOff,
-               frameNumber / 10 % 2 ? 5 : 37); // blink!
+      renderer->drawTile((float)(cursorX * TILESIZE + drawX(cursorRaft) - vx),
+                         (float)(cursorY * TILESIZE + drawY(cursorRaft) - vy),
+                         frameNumber / 10 % 2 ? 5 : 37); // blink!
     }
   }
 }
 
-bool World::mouse(int x, int y)
+uint32_t World::checksum(uint32_t adler) const
 {
+  static const unsigned char blank[CHUNKSIZE*CHUNKSIZE] = { 0 };
+  for (size_t i=0; i<rafts.size(); i++)
+  {
+    int32_t state[6] = { raftX[i], raftY[i], raftW[i], raftH[i], raftVX[i], raftVY[i] };
+    adler = mapChecksum((const unsigned char*)state, sizeof(state), adler);
+    const TileRaft *raft = rafts[i];
+    if (raft->source)
+      raft->page();
+    for (size_t c=0; c<raft->chunks.size(); c++)
+      adler = mapChecksum(raft->chunks[c] ? raft->chunks[c]->tiles : blank, CHUNKSIZE*CHUNKSIZE, adler);
+  }
+
+  double view[3] = { camera.x, camera.y, camera.zoom };
+  adler = mapChecksum((const unsigned char*)view, sizeof(view), adler);
+  int32_t cursor[5] = { editMode, cursorRaft, cursorX, cursorY, pickedTile };
+  return mapChecksum((const unsigned char*)cursor, sizeof(cursor), adler);
+}
+
+bool World::mouse(int sx, int sy)
+{
+  if (panning)
+    camera.drag(sx - mouseX, sy - mouseY);
+  mouseX = sx;
+  mouseY = sy;
+
   if (!editMode)
     return false;
 
-  OGLCONSOLE_Print("World::mouse(%d, %d)\n", x, y);
-  x -= xOff;
-  y -= yOff;
+  LOGT(LOG_INPUT, "World::mouse(%d, %d)\n", sx, sy);
+  int x = clampCoord(floor(camera.worldX(sx)));
+  int y = clampCoord(floor(camera.worldY(sy)));
 
-  for (unsigned int i=0; i<rafts.size(); i++)
-  {
-    int tileX;
-    int tileY;
-    TileRaft* raft = rafts[i];
-
-    tileX = (x - raft->xOff) / TILESIZE;
-    tileY = (y - raft->yOff) / TILESIZE;
+  /* The first raft under the cursor wins. Rafts are hit where they are
+   * drawn, which for a moving raft is short of where it is, so that the
+   * tile painted is the one shown under the pointer. */
+  static vector<int> hits;
+  raftsDrawnAt(x, y, hits);
+  if (hits.empty())
+    return false;
 
-    if (tileX >= 0 && tileX < raft->width && tileY >= 0 && tileY < raft->height)
+  TileRaft* raft = rafts[hits[0]];
+  int lastRaft = cursorRaft, lastX = cursorX, lastY = cursorY;
+  cursorRaft = hits[0];
+  cursorX = (x - drawX(cursorRaft)) / TILESIZE;
+  cursorY = (y - drawY(cursorRaft)) / TILESIZE;
+  if (cursorPainting)
+  {
+    /* Motion is only sampled once a frame, so join the samples up with a
+     * line rather than leaving gaps in fast strokes */
+    static vector<int> line;
+    line.clear();
+    if (lastRaft == cursorRaft && lastX >= 0 && lastY >= 0)
+      rasterLine(lastX, lastY, cursorX, cursorY, line);
+    else
     {
-      cursorRaft = i;
-      cursorX = tileX;
-      cursorY = tileY;
-      if (cursorPainting)
-      {
-        raft->tiles[cursorX + cursorY*raft->width] = pickedTile;
-      }
-      return true;
+      line.push_back(cursorX);
+      line.push_back(cursorY);
+    }
+    for (size_t i = 0; i < line.size(); i += 2)
+    {
+      journal.paint(*raft, cursorRaft, line[i], line[i+1], pickedTile);
+      raft->set(line[i], line[i+1], pickedTile);
     }
   }
-  return false;
+  return true;
 }
 
 bool World::mouseButton(int button, bool down)
 {
-  OGLCONSOLE_Print("World::mouseButton(%d, %s)\n", button, down?"pressed":"released");
+  LOGD(LOG_INPUT, "World::mouseButton(%d, %s)\n", button, down?"pressed":"released");
+
+  /* The middle button drags the view about; the wheel, which SDL reports
+   * as buttons 4 (up) and 5 (down), zooms about the cursor */
+  if (button == 2)
+  {
+    panning = down;
+    return true;
+  }
+  if (button == 4 || button == 5)
+  {
+    if (down)
+      camera.zoomBy(button == 4 ? 1.25 : 1 / 1.25, mouseX, mouseY);
+    return true;
+  }
+
   if (editMode)
   {
     if (down && validateCursor())
     {
-      OGLCONSOLE_Print("World::mouseButton() acting..\n");
+      LOGD(LOG_INPUT, "World::mouseButton() acting..\n");
 
       TileRaft* raft = rafts[cursorRaft];
 
       if (button == 3)
       {
-        pickedTile = raft->tiles[cursorX + cursorY*raft->width];
+        pickedTile = raft->get(cursorX, cursorY);
       }
 
       else if (button == 1)
       {
-        raft->tiles[cursorX + cursorY*raft->width] = pickedTile;
+        journal.paint(*raft, cursorRaft, cursorX, cursorY, pickedTile);
+        raft->set(cursorX, cursorY, pickedTile);
         cursorPainting = true;
       }
     }
     else if (cursorPainting && !down)
     {
       cursorPainting = false;
+      journal.endStroke();
     }
   }
   return false;
 }
 
+bool World::key(int key, bool down)
+{
+  /* Pan while the arrow keys are held. Letting go of one only stops the
+   * pan if it's still going that way. */
+  int dx = 0, dy = 0;
+  switch (key)
+  {
+    case SDLK_LEFT:  dx = -1; break;
+    case SDLK_RIGHT: dx = 1;  break;
+    case SDLK_UP:    dy = -1; break;
+    case SDLK_DOWN:  dy = 1;  break;
+
+    case SDLK_PLUS:
+    case SDLK_EQUALS:
+    case SDLK_KP_PLUS:
+    case SDLK_PAGEUP:
+      if (down)
+        camera.zoomBy(2, ScreenWidth / 2, ScreenHeight / 2);
+      return true;
+
+    case SDLK_MINUS:
+    case SDLK_KP_MINUS:
+    case SDLK_PAGEDOWN:
+      if (down)
+        camera.zoomBy(0.5, ScreenWidth / 2, ScreenHeight / 2);
+      return true;
+
+    default:
+      return false;
+  }
+
+  if (down)
+  {
+    if (dx) camera.panX = dx;
+    if (dy) camera.panY = dy;
+  }
+  else
+  {
+    if (dx && camera.panX == dx) camera.panX = 0;
+    if (dy && camera.panY == dy) camera.panY = 0;
+  }
+  return true;
+}
+
 ostream& operator<<(ostream& out, const World& world)
 {
   out << "LD26____MAPFILE "
@@ -241,58 +599,37 @@ ostream& operator<<(ostream& out, const World& world)
   return out;
 }
 
-ostream& operator<<(ostream& out, const TileRaft& raft)
-{
-  out << "raft"
-      << raft.width << ' '
-      << raft.height << ' ';
-  for (int i=0; i<raft.width*raft.height; i++)
-    out << raft.tiles[i];
-
-  return out;
-}
-
-TileRaft::TileRaft(istream& in)
-{
-  char magic[5];
-  in.read(magic, 4);
-  magic[4] = '\0';
-  OGLCONSOLE_Print("TileRaft::TileRaft(istream) magic: %s\n", magic);
-  in >> width
-     >> height;
-  OGLCONSOLE_Print("TileRaft::TileRaft(istream) dimensions: %dx%d\n", width, height);
-  tiles.resize(width*height);
-  char sp;
-  in.read(&sp, 1); // eat extra space
-  in.read(((char*)&tiles[0]), width*height);
-  xOff = 0;
-  yOff = 0;
-}
-
-World::World(istream& in)
+void World::load(istream& in)
 {
   char magic[16];
   unsigned int nrafts;
   in.read(magic, 15);
   magic[15] = '\0';
-  OGLCONSOLE_Print("World::World(istream) magic: \"%s\"\n", magic);
+  LOGD(LOG_MAP, "World::load(istream) magic: \"%s\"\n", magic);
   in >> nrafts;
-  OGLCONSOLE_Print("World::World(istream) loading %d tile rafts\n", nrafts);
-  rafts.resize(nrafts);
+  LOGD(LOG_MAP, "World::load(istream) loading %d tile rafts\n", nrafts);
   char sp;
   in.read(&sp, 1); // eat extra space
   for (unsigned int i=0; i<nrafts; i++)
   {
-    rafts[i] = new TileRaft(in);
+    if (useArena)
+      addRaft(new (arena.alloc(sizeof(TileRaft))) TileRaft(in, &arena));
+    else
+      addRaft(new TileRaft(in));
   }
+}
 
-  xOff = 0;
-  yOff = 0;
-  editMode = true;
-  cursorX = -1;
-  cursorY = -1;
-  cursorRaft = -1;
-  cursorPainting = false;
+void World::load(MapFile *file)
+{
+  if (mapFile)
+    autosaveWait();
+  delete mapFile;
+  mapFile = file;
+  LOGD(LOG_MAP, "World::load(MapFile) loading %d tile rafts\n", file->header->nrafts);
+  for (unsigned int i=0; i<file->header->nrafts; i++)
+  {
+    addRaft(file->makeRaft(i, useArena ? &arena : NULL));
+  }
 }
 
 
@@ -307,48 +644,39 @@ namespace Game
     void Init()
     {
       TileRaft *raft = new TileRaft(16, 16);
-      for (int i=0; i<16*16; i++) raft->tiles[i] = i;
-      scratchWorld->rafts.push_back(raft);
+      for (int i=0; i<16*16; i++) raft->set(i%16, i/16, i);
+      scratchWorld->addRaft(raft);
     }
 
     void Step()
     {
       stepNumber++;
+      gameWorld->step();
+      activeWorld->camera.step();
+      autosavePoll(gameWorld->rafts);
     }
 
     void Quit()
     {
     }
 
-    void Draw()
+    void Draw(double alpha)
     {
+        PERF_SCOPE(PERF_GAME_DRAW);
         frameNumber++;
+        stepAlpha = alpha;
 
-        // Configure the GL
-        glPushAttrib(GL_ALL_ATTRIB_BITS);
-        glDisable(GL_BLEND);
-        glEnable(GL_TEXTURE_2D);
-        glBindTexture(GL_TEXTURE_2D, tilesTexture);
-        glMatrixMode(GL_PROJECTION);
-        glPushMatrix();
-        glMatrixMode(GL_MODELVIEW);
-        glPushMatrix();
-        glOrtho(0, ScreenWidth, ScreenHeight, 0, 1, -1);
+        double vx, vy, vzoom;
+        activeWorld->camera.view(alpha, vx, vy, vzoom);
+        renderer->beginFrame(ScreenWidth, ScreenHeight, vzoom);
 
         /* Draw the world */
-        glBegin(GL_QUADS);
-        activeWorld->draw();
-        glEnd();
-
-        // Relinquish the GL
-        glMatrixMode(GL_PROJECTION);
-        glPopMatrix();
-        glMatrixMode(GL_MODELVIEW);
-        glPopMatrix();
-        glPopAttrib();
+        {
+          PERF_SCOPE(PERF_WORLD_DRAW);
+          activeWorld->draw(vx, vy, vzoom);
+        }
 
-        static unsigned int err=0;
-        glError(NULL, &err);
+        renderer->endFrame();
     }
 
     void Mouse(int x, int y)
@@ -370,7 +698,7 @@ namespace Game
                 switch (e->key.keysym.sym)
                 {
                   case SDLK_F3:
-                    OGLCONSOLE_Print("scratch toggle\n");
+                    conPrint("scratch toggle\n");
                     activeWorld =
                       activeWorld == gameWorld ?
                       scratchWorld : gameWorld;
@@ -389,7 +717,7 @@ namespace Game
       switch (key)
       {
         case SDLK_F3:
-          OGLCONSOLE_Print("scratch toggle\n");
+          conPrint("scratch toggle\n");
           activeWorld =
             activeWorld == gameWorld ?
             scratchWorld : gameWorld;
@@ -398,10 +726,10 @@ namespace Game
         default:
           break;
       }
-      return false;
+      return activeWorld->key(key, down);
     }
 
-    static string mapFilename(string filename)
+    string mapFilename(string filename)
     {
       string filename2 = "data/maps/";
       filename2 += filename;
@@ -410,6 +738,25 @@ namespace Game
     }
 
     bool SaveMap(string filename)
+    {
+      filename = mapFilename(filename);
+
+      if (!MapFile::write(filename, gameWorld->rafts))
+        return false;
+
+      for (vector<TileRaft*>::iterator raft = gameWorld->rafts.begin(); raft != gameWorld->rafts.end(); ++raft)
+        (*raft)->clearDirty();
+
+      conPrint("saved map file \"%s\"\n", filename.c_str());
+      return true;
+    }
+
+    bool Autosave()
+    {
+      return autosaveNow(gameWorld->rafts);
+    }
+
+    bool SaveTextMap(string filename)
     {
       ofstream f;
       filename = mapFilename(filename);
@@ -418,33 +765,80 @@ namespace Game
       f << *gameWorld;
       f.close();
 
-      OGLCONSOLE_Print("saved map file \"%s\"\n", filename.c_str());
+      if (!f)
+      {
+        LOGE(LOG_MAP, "error writing map file \"%s\"\n", filename.c_str());
+        return false;
+      }
+
+      conPrint("saved text map file \"%s\"\n", filename.c_str());
       return true;
     }
 
+    /* Clear "into" and load a map file of either format into it, returning
+     * false on failure */
+    bool loadWorld(string filename, World *into)
+    {
+      into->clear();
+      if (MapFile::detect(filename))
+      {
+        MapFile *file = MapFile::open(filename);
+        if (!file)
+          return false;
+        into->load(file);
+        return true;
+      }
+
+      ifstream f(filename.c_str());
+      if (!f)
+      {
+        LOGW(LOG_MAP, "could not read map file \"%s\"\n", filename.c_str());
+        return false;
+      }
+      into->load(f);
+      return true;
+    }
+
+    /* Maps are loaded into spareWorld, which becomes the gameWorld if that
+     * works. The old gameWorld is then cleared and kept as the spare, so
+     * that its arena memory is reused by the next load. */
+    static World *spareWorld = NULL;
+
     bool LoadMap(string filename)
     {
       filename = mapFilename(filename);
-      ifstream f(filename.c_str());
+      if (!spareWorld)
+        spareWorld = new World;
+      if (!loadWorld(filename, spareWorld))
+      {
+        spareWorld->clear();
+        return false;
+      }
 
-      if (gameWorld)
-        delete gameWorld;
-      gameWorld = new World(f);
+      spareWorld->journal.setBudget(gameWorld->journal.budget);
+      swap(gameWorld, spareWorld);
+      spareWorld->clear();
       activeWorld = gameWorld;
-      f.close();
 
-      OGLCONSOLE_Print("loaded map file \"%s\"\n", filename.c_str());
+      conPrint("loaded map file \"%s\"\n", filename.c_str());
       return true;
     }
 
+    /* Fill [x0,x1) x [y0,y1) of the cursor's raft, as one undo step */
+    static void fillRect(unsigned char tile, int x0, int y0, int x1, int y1)
+    {
+      TileRaft* raft = activeWorld->rafts[activeWorld->cursorRaft];
+      activeWorld->journal.beginRect(*raft, activeWorld->cursorRaft, x0, y0, x1, y1);
+      regionFill(*raft, x0, y0, x1, y1, tile);
+      activeWorld->journal.endRect(*raft);
+    }
+
     void fillMap(unsigned char tile)
     {
       if (activeWorld->validateCursor())
       {
         TileRaft* raft = activeWorld->rafts[activeWorld->cursorRaft];
-        for (int y=0; y<raft->height; y++)
-        for (int x=0; x<raft->width; x++)
-          raft->tiles[x+y*raft->width] = tile;
+        fillRect(tile, 0, 0, raft->width, raft->height);
       }
     }
 
@@ -453,8 +847,8 @@ namespace Game
       if (activeWorld->validateCursor())
       {
         TileRaft* raft = activeWorld->rafts[activeWorld->cursorRaft];
-        for (int x=0; x<raft->width; x++)
-          raft->tiles[x+activeWorld->cursorY*raft->width] = activeWorld->pickedTile;
+        fillRect(activeWorld->pickedTile,
+            0, activeWorld->cursorY, raft->width, activeWorld->cursorY + 1);
       }
     }
 
@@ -463,8 +857,8 @@ namespace Game
       if (activeWorld->validateCursor())
       {
         TileRaft* raft = activeWorld->rafts[activeWorld->cursorRaft];
-        for (int y=0; y<raft->height; y++)
-          raft->tiles[activeWorld->cursorX+y*raft->width] = activeWorld->pickedTile;
+        fillRect(activeWorld->pickedTile,
+            activeWorld->cursorX, 0, activeWorld->cursorX + 1, raft->height);
       }
     }
 
@@ -473,33 +867,149 @@ namespace Game
       if (activeWorld->validateCursor())
       {
         TileRaft* raft = activeWorld->rafts[activeWorld->cursorRaft];
-        int minX, maxX, minY, maxY, dX, dY;
-        if (vertical)
-        {
-          minX = 0;
-          maxX = raft->width;
-          dX = 1;
-          if (ascending)
-          {
-            minY = activeWorld->cursorY;
-            maxY = raft->height;
-          }
-          else
-          {
-            minY = 0;
-            maxY = activeWorld->cursorY + 1;
-          }
-        }
+        int x0 = 0, y0 = 0, x1 = raft->width, y1 = raft->height;
+        int& lo = vertical ? y0 : x0;
+        int& hi = vertical ? y1 : x1;
+        int cursor = vertical ? activeWorld->cursorY : activeWorld->cursorX;
+        if (ascending)
+          lo = cursor;
         else
-        {
-          return; // TODO implement horizontal
-        }
+          hi = cursor + 1;
+        fillRect(activeWorld->pickedTile, x0, y0, x1, y1);
+      }
+    }
+
+    static BucketStack bucketStack;
+
+    void BucketFill(bool diagonal)
+    {
+      if (activeWorld->validateCursor())
+      {
+        activeWorld->bucketFill(activeWorld->cursorRaft, activeWorld->cursorX, activeWorld->cursorY,
+            activeWorld->pickedTile, diagonal, bucketStack);
+      }
+    }
+
+    void SetVelocity(int vx, int vy)
+    {
+      if (activeWorld->validateCursor())
+      {
+        activeWorld->raftVX[activeWorld->cursorRaft] = vx;
+        activeWorld->raftVY[activeWorld->cursorRaft] = vy;
+      }
+    }
+
+    void FindPath(int x, int y, bool jump)
+    {
+      if (!activeWorld->validateCursor())
+        return;
+      World& w = *activeWorld;
+      const NavGrid& grid = w.navGrid(w.cursorRaft);
+      if (grid.chunksBuilt)
+        conPrint("rebuilt %d chunks of the navigation grid\n", grid.chunksBuilt);
+
+      static NavSearch search;
+      NavPath path;
+      double t0 = timerSeconds();
+      bool found = navFindPath(grid, w.cursorX, w.cursorY, x, y, path, search, jump);
+      double ms = (timerSeconds() - t0) * 1000;
+      if (!found)
+      {
+        conPrint("no path from (%d, %d) to (%d, %d), %d nodes expanded in %.3f ms\n",
+            w.cursorX, w.cursorY, x, y, path.expanded, ms);
+        return;
+      }
+      conPrint("path of cost %.2f through %d waypoints, %d nodes expanded in %.3f ms:\n",
+          path.cost, (int)path.points.size() / 2, path.expanded, ms);
+      for (size_t i=0; i<path.points.size() && i<32; i+=2)
+        conPrint(" (%d, %d)", path.points[i], path.points[i+1]);
+      conPrint(path.points.size() > 32 ? " ...\n" : "\n");
+    }
+
+    void SetWalkable(int tile, bool walkable)
+    {
+      navTiles.set(tile, walkable);
+    }
+
+    /* Tiles lifted by Copy(), for Paste() */
+    static TileRegion clipboard;
+
+    void Copy(int w, int h)
+    {
+      if (activeWorld->validateCursor())
+      {
+        TileRaft* raft = activeWorld->rafts[activeWorld->cursorRaft];
+        regionCopy(*raft, activeWorld->cursorX, activeWorld->cursorY,
+            activeWorld->cursorX + w, activeWorld->cursorY + h, clipboard);
+      }
+    }
 
-            dY = 1;
-        for (int y = minY; y != maxY; y += dY)
-        for (int x = minX; x != maxX; x += dX)
-          raft->tiles[x+y*raft->width] = activeWorld->pickedTile;
+    void Paste(bool masked)
+    {
+      if (activeWorld->validateCursor())
+      {
+        TileRaft* raft = activeWorld->rafts[activeWorld->cursorRaft];
+        int x = activeWorld->cursorX, y = activeWorld->cursorY;
+        activeWorld->journal.beginRect(*raft, activeWorld->cursorRaft,
+            x, y, x + clipboard.width, y + clipboard.height);
+        regionPaste(*raft, clipboard, x, y, masked);
+        activeWorld->journal.endRect(*raft);
       }
     }
+
+    bool Undo()
+    {
+      return activeWorld->journal.undo(activeWorld->rafts);
+    }
+
+    bool Redo()
+    {
+      return activeWorld->journal.redo(activeWorld->rafts);
+    }
+
+    void SetUndoBudget(size_t bytes)
+    {
+      gameWorld->journal.setBudget(bytes);
+      scratchWorld->journal.setBudget(bytes);
+    }
+
+    void UndoStats()
+    {
+      UndoJournal& j = activeWorld->journal;
+      conPrint("undo: %u steps, %u redo steps, %u of %u KiB\n",
+          (unsigned) j.undoSteps(), (unsigned) j.redoSteps(),
+          (unsigned) (j.bytes / 1024), (unsigned) (j.budget / 1024));
+    }
+
+    int TilesSubmitted()
+    {
+      return tilesSubmitted;
+    }
+
+    uint32_t Checksum()
+    {
+      int32_t state[2] = { stepNumber, activeWorld == gameWorld };
+      uint32_t adler = mapChecksum((const unsigned char*)state, sizeof(state));
+      adler = gameWorld->checksum(adler);
+      return scratchWorld->checksum(adler);
+    }
+
+    void DrawStats()
+    {
+      static const char *lods[] = { "tiles", "chunk overviews", "raft overviews" };
+      const Camera& c = activeWorld->camera;
+      conPrint("view at (%.0f, %.0f), zoom %g, drawn as %s\n", c.x, c.y, c.zoom, lods[lastLod]);
+      conPrint("last frame: %d tiles submitted, %d tiles culled, %d overviews\n",
+          tilesSubmitted, tilesSkipped, overviewsSubmitted);
+      conPrint("chunk overviews: %lu drawn, %lu uploaded, %lu evicted, %lu KiB\n",
+          glRenderer.overviews.hits, glRenderer.overviews.uploads,
+          glRenderer.overviews.evictions, (unsigned long)(glRenderer.overviews.bytes() >> 10));
+    }
+
+    void Zoom(double zoom)
+    {
+      Camera& c = activeWorld->camera;
+      c.zoomBy(zoom / c.targetZoom, ScreenWidth / 2, ScreenHeight / 2);
+    }
 };
 
@@ -2,12 +2,16 @@
 #define INTERACTIVE_APPLICATION_HXX
 #include <SDL_events.h>
 #include <string>
+#include <stddef.h>
+#include <stdint.h>
 
 namespace Game
 {
     void Init();
     void Step();
-    void Draw();
+    /* alpha is how far between the last Step() and the next one this frame
+     * falls, in [0,1], for interpolating anything that moves */
+    void Draw(double alpha=1);
     void Quit();
     void Mouse(int x, int y);
     bool MouseButton(int button, bool down);
@@ -15,12 +19,53 @@ namespace Game
     bool SDLEvent(SDL_Event *e);
 
     bool SaveMap(std::string filename);
+    bool SaveTextMap(std::string filename);
     bool LoadMap(std::string filename);
+    /* Start a background save of the game world to the autosave file */
+    bool Autosave();
 
     void fillMap(unsigned char tile);
     void fillH();
     void fillV();
     void flood(bool vertical, bool ascending);
+    /* Copy w x h tiles from the cursor into the clipboard, and paste them
+     * back at the cursor */
+    void Copy(int w, int h);
+    void Paste(bool masked);
+    /* Bucket fill from the cursor with the picked tile */
+    void BucketFill(bool diagonal);
+    /* Set the velocity of the raft under the cursor, in pixels per step */
+    void SetVelocity(int vx, int vy);
+    /* Find a path from the cursor to tile (x, y) of the cursor's raft, by
+     * jump point search or plain A* */
+    void FindPath(int x, int y, bool jump);
+    void SetWalkable(int tile, bool walkable);
+
+    /* Undo or redo the last edit to the active world */
+    bool Undo();
+    bool Redo();
+    /* Limit on the memory each world's undo journal may use */
+    void SetUndoBudget(size_t bytes);
+    void UndoStats();
+
+    /* Benchmarks, in benchmarks.cxx */
+    void BenchLoad(std::string filename, int times);
+    void BenchDraw(int frames);
+    void BenchRle(int tiles);
+    void BenchRegion(int megatiles);
+    void BenchBucket(int megatiles);
+    void BenchRafts();
+    void BenchJobs();
+    void BenchTiles(int megatiles);
+    void BenchPaths(int size, int queries);
+    void BenchZoom(int nrafts);
+    void DrawStats();
+    /* Zoom the view towards zoom screen pixels per world pixel */
+    void Zoom(double zoom);
+    int TilesSubmitted();
+    /* Checksum of the state of both worlds, which a replayed input log
+     * should reproduce exactly */
+    uint32_t Checksum();
 };
 #endif
 
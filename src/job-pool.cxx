@@ -0,0 +1,247 @@
+#include "console.hxx"
+#include "log.hxx"
+#include "job-pool.hxx"
+#include <SDL.h>
+#include <SDL_thread.h>
+#include <stdint.h>
+#include <algorithm>
+#include <deque>
+#if defined(_WIN32)
+#  include <windows.h>
+#else
+#  include <unistd.h>
+#endif
+using namespace std;
+
+#define JOB_MAXTHREADS 64
+
+struct JobRange {
+  JobFunc func;
+  void *data;
+  int begin;
+  int end;
+};
+
+/* Owners take from the back, thieves from the front */
+struct JobQueue {
+  SDL_mutex *lock;
+  deque<JobRange> ranges;
+};
+
+/* Queue 0 belongs to the main thread, the rest to the workers */
+static JobQueue queues[JOB_MAXTHREADS];
+static SDL_Thread *workers[JOB_MAXTHREADS];
+static int threads = 1;
+static Uint32 mainThread;
+/* Set while the main thread is inside parallelFor() */
+static bool running = false;
+
+/* Workers sleep on wake until generation changes, i.e. until there is new
+ * work; the main thread sleeps on done until pending, the number of ranges
+ * not yet finished, drops to 0 */
+static SDL_mutex *poolLock;
+static SDL_cond *wake;
+static SDL_cond *done;
+static unsigned int generation = 0;
+static volatile int pending = 0;
+static bool quitting = false;
+
+/* Statistics */
+static volatile unsigned long rangesRun = 0;
+static volatile unsigned long rangesStolen = 0;
+
+/* Take a range, from thread self's queue if it has any, else from another's */
+static bool take(int self, JobRange& out)
+{
+  JobQueue& own = queues[self];
+  SDL_LockMutex(own.lock);
+  bool found = !own.ranges.empty();
+  if (found)
+  {
+    out = own.ranges.back();
+    own.ranges.pop_back();
+  }
+  SDL_UnlockMutex(own.lock);
+  if (found)
+    return true;
+
+  for (int k=1; k<threads; k++)
+  {
+    JobQueue& victim = queues[(self + k) % threads];
+    SDL_LockMutex(victim.lock);
+    found = !victim.ranges.empty();
+    if (found)
+    {
+      out = victim.ranges.front();
+      victim.ranges.pop_front();
+    }
+    SDL_UnlockMutex(victim.lock);
+    if (found)
+    {
+      __sync_fetch_and_add(&rangesStolen, 1);
+      return true;
+    }
+  }
+  return false;
+}
+
+/* Run ranges until there are none left anywhere */
+static void work(int self)
+{
+  JobRange r;
+  while (take(self, r))
+  {
+    r.func(r.data, r.begin, r.end);
+    __sync_fetch_and_add(&rangesRun, 1);
+    if (__sync_sub_and_fetch(&pending, 1) == 0)
+    {
+      SDL_LockMutex(poolLock);
+      SDL_CondSignal(done);
+      SDL_UnlockMutex(poolLock);
+    }
+  }
+}
+
+static int workerMain(void *arg)
+{
+  int self = (int)(intptr_t)arg;
+  SDL_LockMutex(poolLock);
+  unsigned int seen = generation;
+  for (;;)
+  {
+    while (generation == seen && !quitting)
+      SDL_CondWait(wake, poolLock);
+    if (quitting)
+    {
+      SDL_UnlockMutex(poolLock);
+      return 0;
+    }
+    seen = generation;
+    SDL_UnlockMutex(poolLock);
+
+    work(self);
+    SDL_LockMutex(poolLock);
+  }
+}
+
+int cpuCount()
+{
+#if defined(_WIN32)
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwNumberOfProcessors;
+#else
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (int)n : 1;
+#endif
+}
+
+void jobStart(int n)
+{
+  jobStop();
+
+  if (n <= 0)
+    n = cpuCount();
+  if (n > JOB_MAXTHREADS)
+    n = JOB_MAXTHREADS;
+
+  if (!poolLock)
+  {
+    poolLock = SDL_CreateMutex();
+    wake = SDL_CreateCond();
+    done = SDL_CreateCond();
+    for (int i=0; i<JOB_MAXTHREADS; i++)
+      queues[i].lock = SDL_CreateMutex();
+  }
+  mainThread = SDL_ThreadID();
+
+  for (threads=1; threads<n; threads++)
+  {
+    workers[threads] = SDL_CreateThread(workerMain, (void*)(intptr_t)threads);
+    if (!workers[threads])
+    {
+      LOGW(LOG_GENERAL, "could not start job thread: %s\n", SDL_GetError());
+      break;
+    }
+  }
+  LOGD(LOG_GENERAL, "job pool: %d threads\n", threads);
+}
+
+void jobStop()
+{
+  if (threads == 1)
+    return;
+
+  SDL_LockMutex(poolLock);
+  quitting = true;
+  SDL_CondBroadcast(wake);
+  SDL_UnlockMutex(poolLock);
+
+  for (int i=1; i<threads; i++)
+    SDL_WaitThread(workers[i], NULL);
+  threads = 1;
+  quitting = false;
+}
+
+int jobThreads()
+{
+  return threads;
+}
+
+void parallelFor(int n, int grain, JobFunc func, void *data)
+{
+  if (n <= 0)
+    return;
+  if (grain < 1)
+    grain = 1;
+
+  if (threads == 1 || n <= grain || running || SDL_ThreadID() != mainThread)
+  {
+    func(data, 0, n);
+    return;
+  }
+
+  /* Deal the ranges out in contiguous runs, so that neighbouring indices,
+   * which often share cache lines, tend to stay on one thread */
+  int count = (n + grain - 1) / grain;
+  running = true;
+  pending = count;
+  for (int t=0; t<threads; t++)
+  {
+    JobQueue& q = queues[t];
+    int first = (int)((long long)count * t / threads);
+    int last = (int)((long long)count * (t + 1) / threads);
+    SDL_LockMutex(q.lock);
+    /* Pushed in reverse, so that the owner, which pops from the back,
+     * works through them in ascending order */
+    for (int i=last-1; i>=first; i--)
+    {
+      JobRange r;
+      r.func = func;
+      r.data = data;
+      r.begin = i * grain;
+      r.end = min(n, r.begin + grain);
+      q.ranges.push_back(r);
+    }
+    SDL_UnlockMutex(q.lock);
+  }
+
+  SDL_LockMutex(poolLock);
+  generation++;
+  SDL_CondBroadcast(wake);
+  SDL_UnlockMutex(poolLock);
+
+  work(0);
+
+  SDL_LockMutex(poolLock);
+  while (__sync_fetch_and_add(&pending, 0))
+    SDL_CondWait(done, poolLock);
+  SDL_UnlockMutex(poolLock);
+  running = false;
+}
+
+void jobReport()
+{
+  conPrint("job pool: %d threads (%d CPUs)\n", threads, cpuCount());
+  conPrint("%lu ranges run, %lu stolen\n", rangesRun, rangesStolen);
+}
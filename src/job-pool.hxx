@@ -0,0 +1,42 @@
+#ifndef JOB_POOL_HXX
+#define JOB_POOL_HXX
+
+/* A work-stealing thread pool for CPU-only work that splits into independent
+ * pieces, such as building the meshes of many chunks or encoding many rafts.
+ *
+ *   static void buildMeshes(void *data, int begin, int end) { ... }
+ *   parallelFor(n, 16, buildMeshes, &chunks);
+ *
+ * Each thread has its own queue of index ranges. It takes work from the back
+ * of its own queue and, once that is empty, steals from the front of the
+ * others', so a thread that draws cheap ranges ends up helping with the
+ * expensive ones. The calling thread works too, and parallelFor() returns
+ * once every range is done.
+ *
+ * Which thread runs which range varies from run to run, so for results not
+ * to, each range must only write state belonging to its own indices; any
+ * combining of results is left to the caller, in index order, afterwards.
+ * Jobs mustn't touch the GL or the console, nor allocate from an Arena, and
+ * parallelFor() may only be called from the main thread. Calls from a job
+ * run their ranges inline.
+ */
+
+/* Does the work for indices [begin, end) */
+typedef void (*JobFunc)(void *data, int begin, int end);
+
+/* Start threads-1 workers, so that, with the main thread, there are threads
+ * in all; 0 means one per CPU. Running workers are stopped first, and 1
+ * stops them altogether and runs every job on the main thread. */
+void jobStart(int threads);
+void jobStop();
+/* Threads sharing the work, counting the main thread */
+int jobThreads();
+/* Number of CPUs online */
+int cpuCount();
+
+/* Run func over [0, n) in ranges of about grain indices */
+void parallelFor(int n, int grain, JobFunc func, void *data);
+
+/* Print the thread count and how much work was stolen */
+void jobReport();
+#endif
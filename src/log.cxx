@@ -0,0 +1,245 @@
+#include "console.hxx"
+#include "log.hxx"
+#include "timer.hxx"
+#include <SDL.h>
+#include <SDL_thread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Ring sizes must be powers of two so that the counters may wrap */
+#define LOG_SLOTS 256
+#define LOG_TEXT 240
+/* How long the writer thread sleeps between looks at the ring */
+#define LOG_INTERVAL_MS 10
+
+LogLevel logThreshold[LOG_NCATEGORIES] = {
+#ifdef DEBUG
+  LOG_DEBUG, LOG_DEBUG, LOG_DEBUG, LOG_DEBUG
+#else
+  LOG_INFO, LOG_INFO, LOG_INFO, LOG_INFO
+#endif
+};
+LogLevel logConsoleLevel = LOG_INFO;
+
+static const char *levelNames[LOG_NLEVELS] = {
+  "trace", "debug", "info", "warn", "error"
+};
+
+static const char *categoryNames[LOG_NCATEGORIES] = {
+  "general", "input", "map", "render"
+};
+
+struct LogEntry {
+  /* Set by the producer once the rest of the entry is written, and cleared
+   * by the writer thread once it's done with it */
+  volatile int ready;
+  double time;
+  LogLevel level;
+  LogCategory category;
+  char text[LOG_TEXT];
+};
+
+/* Written to by any thread, read by the writer thread. head counts slots
+ * ever claimed, tail slots ever released. */
+static LogEntry ring[LOG_SLOTS];
+static volatile unsigned int head;
+static volatile unsigned int tail;
+
+/* Written to by the writer thread, read by the main thread in logPump() */
+static char consoleRing[LOG_SLOTS][LOG_TEXT];
+static volatile unsigned int consoleHead;
+static volatile unsigned int consoleTail;
+
+static volatile unsigned int messages;
+static volatile unsigned int dropped;
+static volatile unsigned int totalSuppressed;
+
+static SDL_Thread *writer;
+static volatile bool writerQuit;
+static FILE *logFile;
+
+const char *logLevelName(int level)
+{
+  return level >= 0 && level < LOG_NLEVELS ? levelNames[level] : "?";
+}
+
+const char *logCategoryName(int category)
+{
+  return category >= 0 && category < LOG_NCATEGORIES ? categoryNames[category] : "?";
+}
+
+int logLevelByName(const char *name)
+{
+  for (int i=0; i<LOG_NLEVELS; i++)
+    if (strcmp(name, levelNames[i]) == 0)
+      return i;
+  return -1;
+}
+
+int logCategoryByName(const char *name)
+{
+  for (int i=0; i<LOG_NCATEGORIES; i++)
+    if (strcmp(name, categoryNames[i]) == 0)
+      return i;
+  return -1;
+}
+
+void logWrite(LogLevel level, LogCategory category, const char *fmt, ...)
+{
+  va_list ap;
+  __sync_fetch_and_add(&messages, 1);
+
+  if (!writer)
+  {
+    char buf[LOG_TEXT];
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    conPrint("%s", buf);
+    return;
+  }
+
+  /* Claim a slot, or drop the message if the writer has fallen behind */
+  unsigned int h;
+  do
+  {
+    h = head;
+    if (h - tail >= LOG_SLOTS)
+    {
+      __sync_fetch_and_add(&dropped, 1);
+      return;
+    }
+  }
+  while (!__sync_bool_compare_and_swap(&head, h, h + 1));
+
+  LogEntry& e = ring[h % LOG_SLOTS];
+  e.time = timerSeconds();
+  e.level = level;
+  e.category = category;
+  va_start(ap, fmt);
+  vsnprintf(e.text, sizeof(e.text), fmt, ap);
+  va_end(ap);
+  __sync_synchronize();
+  e.ready = 1;
+}
+
+bool LogLimiter::allow(LogLevel level, LogCategory category)
+{
+  double t = timerSeconds();
+  if (t - windowStart >= 1)
+  {
+    unsigned int n = suppressed;
+    windowStart = t;
+    count = 0;
+    suppressed = 0;
+    if (n)
+      logWrite(level, category, "(%u similar messages suppressed)\n", n);
+  }
+  if (count >= LOG_RATE)
+  {
+    suppressed++;
+    __sync_fetch_and_add(&totalSuppressed, 1);
+    return false;
+  }
+  count++;
+  return true;
+}
+
+/* Write out every entry that is ready. Only the writer thread (or logStop(),
+ * once it has been joined) calls this. */
+static void drain()
+{
+  bool wrote = false;
+  for (;;)
+  {
+    LogEntry& e = ring[tail % LOG_SLOTS];
+    if (!e.ready)
+      break;
+    __sync_synchronize();
+
+    if (logFile)
+    {
+      fprintf(logFile, "%10.3f %-5s %-7s %s", e.time, levelNames[e.level],
+          categoryNames[e.category], e.text);
+      wrote = true;
+    }
+    if (e.level >= logConsoleLevel)
+    {
+      if (consoleHead - consoleTail < LOG_SLOTS)
+      {
+        memcpy(consoleRing[consoleHead % LOG_SLOTS], e.text, LOG_TEXT);
+        __sync_synchronize();
+        consoleHead++;
+      }
+      else
+        __sync_fetch_and_add(&dropped, 1);
+    }
+
+    e.ready = 0;
+    __sync_synchronize();
+    tail++;
+  }
+  if (wrote)
+    fflush(logFile);
+}
+
+static int writerMain(void *)
+{
+  while (!writerQuit)
+  {
+    drain();
+    SDL_Delay(LOG_INTERVAL_MS);
+  }
+  return 0;
+}
+
+void logStart(const char *filename)
+{
+  if (writer)
+    return;
+  if (filename)
+  {
+    logFile = fopen(filename, "a");
+    if (!logFile)
+      conPrint("could not open log file \"%s\"\n", filename);
+  }
+  writerQuit = false;
+  writer = SDL_CreateThread(writerMain, NULL);
+  if (!writer)
+    conPrint("could not start log writer: %s\n", SDL_GetError());
+}
+
+void logStop()
+{
+  if (!writer)
+    return;
+  writerQuit = true;
+  SDL_WaitThread(writer, NULL);
+  writer = NULL;
+  drain();
+  logPump();
+  if (logFile)
+    fclose(logFile);
+  logFile = NULL;
+}
+
+void logPump()
+{
+  while (consoleTail != consoleHead)
+  {
+    __sync_synchronize();
+    conPrint("%s", consoleRing[consoleTail % LOG_SLOTS]);
+    __sync_synchronize();
+    consoleTail++;
+  }
+}
+
+void logReport()
+{
+  for (int c=0; c<LOG_NCATEGORIES; c++)
+    conPrint("%-8s %s\n", categoryNames[c], levelNames[logThreshold[c]]);
+  conPrint("console  %s\n", levelNames[logConsoleLevel]);
+  conPrint("%u messages, %u rate-limited, %u dropped%s\n", messages, totalSuppressed, dropped,
+      logFile ? "" : ", no log file");
+}
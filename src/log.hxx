@@ -0,0 +1,106 @@
+#ifndef LOG_HXX
+#define LOG_HXX
+
+/* Diagnostic logging
+ *
+ *   LOGD(LOG_INPUT, "button %d\n", button);
+ *
+ * Messages below a category's threshold are dropped before any formatting is
+ * done, and each call site may log at most LOG_RATE messages per second; the
+ * rest are counted and reported as suppressed. Formatted messages go into a
+ * lock-free ring buffer, which a background thread drains to the log file.
+ * Those meant for the console are handed back to the main thread, which
+ * prints them from logPump(), since the console may only be touched there.
+ *
+ * LOGT() and LOGD() compile to nothing unless DEBUG is defined, and
+ * -DNO_LOG removes every level. Stripped calls are still type-checked, and
+ * still count as uses of their arguments, but generate no code.
+ */
+
+enum LogLevel {
+  LOG_TRACE,
+  LOG_DEBUG,
+  LOG_INFO,
+  LOG_WARN,
+  LOG_ERROR,
+  LOG_NLEVELS
+};
+
+enum LogCategory {
+  LOG_GENERAL,
+  LOG_INPUT,
+  LOG_MAP,
+  LOG_RENDER,
+  LOG_NCATEGORIES
+};
+
+/* Per-call-site message budget, per second */
+#define LOG_RATE 20
+
+/* Messages below logThreshold[category] are dropped; messages at or above
+ * logConsoleLevel are printed to the console as well as the log file */
+extern LogLevel logThreshold[LOG_NCATEGORIES];
+extern LogLevel logConsoleLevel;
+
+/* Start the writer thread, appending to filename if it isn't NULL. Until
+ * this is called, messages are printed straight away with conPrint(). */
+void logStart(const char *filename);
+/* Flush everything still queued and stop the writer thread */
+void logStop();
+/* Print queued console messages; call from the main thread */
+void logPump();
+/* Print the thresholds and message counts */
+void logReport();
+
+const char *logLevelName(int level);
+const char *logCategoryName(int category);
+/* Index of the level or category with the given name, or -1 */
+int logLevelByName(const char *name);
+int logCategoryByName(const char *name);
+
+void logWrite(LogLevel level, LogCategory category, const char *fmt, ...)
+#ifdef __GNUC__
+  __attribute__((format(printf, 3, 4)))
+#endif
+  ;
+
+struct LogLimiter {
+  double windowStart;
+  unsigned int count;
+  unsigned int suppressed;
+
+  LogLimiter() : windowStart(0), count(0), suppressed(0) {}
+
+  /* False if this call site has used up its budget for the current second.
+   * Not thread-safe, but a race only miscounts a message or two. */
+  bool allow(LogLevel level, LogCategory category);
+};
+
+#define LOG_NONE(level, category, ...) do { \
+   if (0) \
+     logWrite(level, category, __VA_ARGS__); \
+ } while (0)
+
+#ifdef NO_LOG
+#  define LOG_AT LOG_NONE
+#else
+#  define LOG_AT(level, category, ...) do { \
+     if ((level) >= logThreshold[category]) { \
+       static LogLimiter logLimiter_; \
+       if (logLimiter_.allow(level, category)) \
+         logWrite(level, category, __VA_ARGS__); \
+     } \
+   } while (0)
+#endif
+
+#ifdef DEBUG
+#  define LOGT(category, ...) LOG_AT(LOG_TRACE, category, __VA_ARGS__)
+#  define LOGD(category, ...) LOG_AT(LOG_DEBUG, category, __VA_ARGS__)
+#else
+#  define LOGT(category, ...) LOG_NONE(LOG_TRACE, category, __VA_ARGS__)
+#  define LOGD(category, ...) LOG_NONE(LOG_DEBUG, category, __VA_ARGS__)
+#endif
+#define LOGI(category, ...) LOG_AT(LOG_INFO, category, __VA_ARGS__)
+#define LOGW(category, ...) LOG_AT(LOG_WARN, category, __VA_ARGS__)
+#define LOGE(category, ...) LOG_AT(LOG_ERROR, category, __VA_ARGS__)
+#endif
@@ -1,5 +1,17 @@
 #include "oglconsole.h"
 #include "interactive-application.hxx"
+#include "frame-scheduler.hxx"
+#include "timer.hxx"
+#include "profiler.hxx"
+#include "log.hxx"
+#include "job-pool.hxx"
+#include "autosave.hxx"
+#include "console.hxx"
+#include "gl-renderer.hxx"
+#include "soft-renderer.hxx"
+#include "atlas.hxx"
+#include "input-log.hxx"
+#include "startup.hxx"
 //#include "sound.h"
 #ifdef __APPLE__
 #  include <OpenGL/gl.h>
@@ -10,7 +22,9 @@
 #endif
 #include <SDL.h>
 #include <SDL_image.h>
+#include <SDL_thread.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <math.h>
 #include <iostream>
@@ -21,6 +35,7 @@
 #include <vector>
 
 #define FPS 40
+#define TICKRATE 60
 
 using namespace std;
 
@@ -29,11 +44,54 @@ int ScreenWidth=640;
 int ScreenHeight=480;
 Uint32 video_flags = SDL_OPENGL|SDL_RESIZABLE|SDL_DOUBLEBUF;
 
-GLuint tilesTexture;
 SDL_Event event;
 
+FrameScheduler scheduler(TICKRATE, FPS);
+
+/* Joystick 0, opened by the "joystick" command; nothing in the game reads
+ * it yet, so there's no sense paying for it at startup */
+static SDL_Joystick *joystick;
+
+static void openJoystick()
+{
+    if (!SDL_WasInit(SDL_INIT_JOYSTICK) && SDL_InitSubSystem(SDL_INIT_JOYSTICK) < 0)
+    {
+        conPrint("could not initialize joysticks: %s\n", SDL_GetError());
+        return;
+    }
+    if (!joystick)
+    {
+        SDL_JoystickEventState(SDL_ENABLE);
+        joystick = SDL_JoystickOpen(0);
+    }
+    if (joystick)
+        conPrint("joystick 0 open: %s\n", SDL_JoystickName(0));
+    else
+        conPrint("%d joysticks; could not open joystick 0\n", SDL_NumJoysticks());
+}
+
+/* Set while replaying an input log; see replay() */
+static bool replaying = false;
+
+/* Commands a replay skips: they write files (savemap, savetextmap,
+ * autosave, perf trace), draw or hold textures with GL, which a replay has
+ * no context for (rtcache, benchdraw, benchzoom), or open devices
+ * (joystick). None of them changes the game's state. */
+static bool skippedInReplay(const string& command)
+{
+    static const char *skipped[] = {
+        "savemap", "savetextmap", "autosave", "perf", "rtcache",
+        "benchdraw", "benchzoom", "joystick"
+    };
+    for (size_t i=0; i<sizeof(skipped)/sizeof(*skipped); i++)
+        if (command == skipped[i])
+            return true;
+    return false;
+}
+
 #define CHECK_ARGS(n) do{if (tokens.size()!=n) {nae=n;goto wrong_num_args;}}while(0)
 void conCB(OGLCONSOLE_Console console, char* line) {
+  recordCommand(line);
   istringstream iss(line);
   vector<string> tokens;
   copy(istream_iterator<string>(iss),
@@ -41,6 +99,11 @@ void conCB(OGLCONSOLE_Console console, char* line) {
       back_inserter<vector<string> >(tokens));
   if (tokens.size() == 0)
     return;
+  if (replaying && skippedInReplay(tokens[0]))
+  {
+    LOGI(LOG_INPUT, "replay: skipped \"%s\"\n", line);
+    return;
+  }
 
   int nae; // num args expected
 
@@ -56,6 +119,12 @@ void conCB(OGLCONSOLE_Console console, char* line) {
     Game :: SaveMap(tokens[1]);
     return;
   }
+  else if (tokens[0] == "savetextmap")
+  {
+    CHECK_ARGS(2);
+    Game :: SaveTextMap(tokens[1]);
+    return;
+  }
   else if (tokens[0] == "loadmap")
   {
     CHECK_ARGS(2);
@@ -82,50 +151,610 @@ void conCB(OGLCONSOLE_Console console, char* line) {
   else if (tokens[0] == "flood")
   {
     CHECK_ARGS(2);
-    // TODO more directions
-    bool asc;
+    bool vertical, asc;
     if (tokens[1] == "down")
     {
+      vertical = true;
       asc = true;
     }
     else if (tokens[1] == "up")
     {
+      vertical = true;
+      asc = false;
+    }
+    else if (tokens[1] == "right")
+    {
+      vertical = false;
+      asc = true;
+    }
+    else if (tokens[1] == "left")
+    {
+      vertical = false;
       asc = false;
     }
     else
     {
-      OGLCONSOLE_Print("cannot flood \"%s\"\n", tokens[1]);
+      conPrint("cannot flood \"%s\"\n", tokens[1].c_str());
       return;
     }
-    Game :: flood(true, asc);
+    Game :: flood(vertical, asc);
+  }
+  else if (tokens[0] == "bucket")
+  {
+    if (tokens.size() == 1 || (tokens.size() == 2 && tokens[1] == "4"))
+      Game :: BucketFill(false);
+    else if (tokens.size() == 2 && tokens[1] == "8")
+      Game :: BucketFill(true);
+    else
+      conPrint("usage: bucket [4|8]\n");
+  }
+  else if (tokens[0] == "velocity")
+  {
+    CHECK_ARGS(3);
+    Game :: SetVelocity(atoi(tokens[1].c_str()), atoi(tokens[2].c_str()));
+  }
+  else if (tokens[0] == "path" || tokens[0] == "astar")
+  {
+    // path <x> <y>: from the cursor, by jump point search; astar for A*
+    CHECK_ARGS(3);
+    Game :: FindPath(atoi(tokens[1].c_str()), atoi(tokens[2].c_str()), tokens[0] == "path");
+  }
+  else if (tokens[0] == "walkable")
+  {
+    CHECK_ARGS(3);
+    Game :: SetWalkable(atoi(tokens[1].c_str()), atoi(tokens[2].c_str()) != 0);
+  }
+  else if (tokens[0] == "copy")
+  {
+    CHECK_ARGS(3);
+    Game :: Copy(atoi(tokens[1].c_str()), atoi(tokens[2].c_str()));
+  }
+  else if (tokens[0] == "paste")
+  {
+    if (tokens.size() == 1)
+      Game :: Paste(false);
+    else if (tokens.size() == 2 && tokens[1] == "masked")
+      Game :: Paste(true);
+    else
+      conPrint("usage: paste [masked]\n");
+  }
+  else if (tokens[0] == "undo")
+  {
+    CHECK_ARGS(1);
+    if (!Game :: Undo())
+      conPrint("nothing to undo\n");
+  }
+  else if (tokens[0] == "redo")
+  {
+    CHECK_ARGS(1);
+    if (!Game :: Redo())
+      conPrint("nothing to redo\n");
+  }
+  else if (tokens[0] == "undobudget")
+  {
+    CHECK_ARGS(2);
+    Game :: SetUndoBudget(atoi(tokens[1].c_str()) * (size_t) 1024);
+  }
+  else if (tokens[0] == "undostats")
+  {
+    CHECK_ARGS(1);
+    Game :: UndoStats();
+  }
+  else if (tokens[0] == "benchdraw")
+  {
+    CHECK_ARGS(2);
+    Game :: BenchDraw(atoi(tokens[1].c_str()));
+  }
+  else if (tokens[0] == "benchload")
+  {
+    CHECK_ARGS(3);
+    Game :: BenchLoad(tokens[1], atoi(tokens[2].c_str()));
+  }
+  else if (tokens[0] == "benchrle")
+  {
+    CHECK_ARGS(2);
+    Game :: BenchRle(atoi(tokens[1].c_str()));
+  }
+  else if (tokens[0] == "benchregion")
+  {
+    CHECK_ARGS(2);
+    Game :: BenchRegion(atoi(tokens[1].c_str()));
+  }
+  else if (tokens[0] == "benchbucket")
+  {
+    CHECK_ARGS(2);
+    Game :: BenchBucket(atoi(tokens[1].c_str()));
+  }
+  else if (tokens[0] == "benchrafts")
+  {
+    CHECK_ARGS(1);
+    Game :: BenchRafts();
+  }
+  else if (tokens[0] == "benchjobs")
+  {
+    CHECK_ARGS(1);
+    Game :: BenchJobs();
+  }
+  else if (tokens[0] == "benchtiles")
+  {
+    CHECK_ARGS(2);
+    Game :: BenchTiles(atoi(tokens[1].c_str()));
+  }
+  else if (tokens[0] == "benchpaths")
+  {
+    // benchpaths <maze size> <queries>
+    CHECK_ARGS(3);
+    Game :: BenchPaths(atoi(tokens[1].c_str()), atoi(tokens[2].c_str()));
+  }
+  else if (tokens[0] == "autosave")
+  {
+    // autosave [now|off|<seconds>]
+    if (tokens.size() == 1)
+    {
+      autosaveReport();
+      return;
+    }
+    CHECK_ARGS(2);
+    if (tokens[1] == "now")
+    {
+      if (!Game :: Autosave())
+        conPrint("autosave is busy or not running\n");
+    }
+    else if (tokens[1] == "off")
+      autosaveInterval = 0;
+    else
+      autosaveInterval = atof(tokens[1].c_str());
+  }
+  else if (tokens[0] == "threads")
+  {
+    // threads [<n>], 0 meaning one per CPU
+    if (tokens.size() == 1)
+    {
+      jobReport();
+      return;
+    }
+    CHECK_ARGS(2);
+    jobStart(atoi(tokens[1].c_str()));
+  }
+  else if (tokens[0] == "tickrate")
+  {
+    CHECK_ARGS(2);
+    scheduler.setTickRate(atof(tokens[1].c_str()));
+  }
+  else if (tokens[0] == "framerate")
+  {
+    CHECK_ARGS(2);
+    scheduler.setFrameRate(atof(tokens[1].c_str()));
+  }
+  else if (tokens[0] == "ticks")
+  {
+    CHECK_ARGS(1);
+    conPrint("%g ticks/s, %g frames/s max\n", scheduler.tickRate, scheduler.frameRate);
+    conPrint("%lu ticks run, %lu dropped\n", scheduler.ticks, scheduler.droppedTicks);
+    conPrint("tick lateness: last %.3f ms, worst %.3f ms\n",
+        scheduler.tickLateness * 1000, scheduler.maxTickLateness * 1000);
+    conPrint("%lu frames drawn, %lu skipped\n", scheduler.frames, scheduler.skippedFrames);
+    scheduler.resetStats();
+  }
+  else if (tokens[0] == "perf")
+  {
+    if (tokens.size() == 1)
+      perfReport();
+    else if (tokens.size() == 2 && tokens[1] == "on")
+      perfEnabled = true;
+    else if (tokens.size() == 2 && tokens[1] == "off")
+      perfEnabled = false;
+    else if (tokens.size() == 2 && tokens[1] == "reset")
+      perfReset();
+    else if (tokens.size() == 3 && tokens[1] == "trace")
+      perfDumpTrace(tokens[2]);
+    else
+      conPrint("usage: perf [on|off|reset|trace <file.json>]\n");
+  }
+  else if (tokens[0] == "log")
+  {
+    // log [<category>|all|console <level>]
+    if (tokens.size() == 1)
+    {
+      logReport();
+      return;
+    }
+    CHECK_ARGS(3);
+    int level = logLevelByName(tokens[2].c_str());
+    int category = logCategoryByName(tokens[1].c_str());
+    if (level < 0)
+      conPrint("unknown log level \"%s\"\n", tokens[2].c_str());
+    else if (tokens[1] == "console")
+      logConsoleLevel = (LogLevel)level;
+    else if (tokens[1] == "all")
+      for (int c=0; c<LOG_NCATEGORIES; c++)
+        logThreshold[c] = (LogLevel)level;
+    else if (category >= 0)
+      logThreshold[category] = (LogLevel)level;
+    else
+      conPrint("unknown log category \"%s\"\n", tokens[1].c_str());
+  }
+  else if (tokens[0] == "rtcache")
+  {
+    ChunkCache& cache = glRenderer.cache;
+    if (tokens.size() == 2 && tokens[1] == "on")
+      glRenderer.cached = true;
+    else if (tokens.size() == 2 && tokens[1] == "off")
+      glRenderer.cached = false;
+    else if (tokens.size() == 3 && tokens[1] == "budget")
+      cache.setBudget(atoi(tokens[2].c_str()) * (size_t)(1 << 20));
+    else if (tokens.size() == 1)
+    {
+      conPrint("chunk cache %s: %lu pieces, %lu of %lu MiB\n",
+          glRenderer.cached ? "on" : "off", (unsigned long)cache.size(),
+          (unsigned long)(cache.bytes() >> 20), (unsigned long)(cache.budget >> 20));
+      conPrint("%lu hits, %lu captures, %lu evictions\n",
+          cache.hits, cache.captures, cache.evictions);
+    }
+    else
+      conPrint("usage: rtcache [on|off|budget <MiB>]\n");
+  }
+  else if (tokens[0] == "zoom")
+  {
+    CHECK_ARGS(2);
+    Game :: Zoom(atof(tokens[1].c_str()));
+  }
+  else if (tokens[0] == "benchzoom")
+  {
+    CHECK_ARGS(2);
+    Game :: BenchZoom(atoi(tokens[1].c_str()));
+  }
+  else if (tokens[0] == "drawstats")
+  {
+    CHECK_ARGS(1);
+    Game :: DrawStats();
+  }
+  else if (tokens[0] == "startup")
+  {
+    CHECK_ARGS(1);
+    startupReport();
+  }
+  else if (tokens[0] == "joystick")
+  {
+    CHECK_ARGS(1);
+    openJoystick();
   }
   else
   {
-    OGLCONSOLE_Print("Unknown command: \"%s\"\n", tokens[0].c_str());
+    conPrint("Unknown command: \"%s\"\n", tokens[0].c_str());
   }
   return;
 
   wrong_num_args:
-  OGLCONSOLE_Print("Expected %d arguments but found %d\n", nae, tokens.size());
+  conPrint("Expected %d arguments but found %d\n", nae, (int)tokens.size());
 };
 
-SDL_Surface *tileSurface;
+Atlas *tileAtlas;
+
+/* Load the tile set, from its baked cache if that is up to date */
+static bool loadTiles()
+{
+    tileAtlas = Atlas::load("data/tiles.bmp", "data/tiles.atlas", 512, 512);
+    return tileAtlas != NULL;
+}
+
+/* In the game, the tile set is loaded on a thread of its own while the window
+ * and console come up, and uploaded by pollTiles() once it's there */
+static SDL_Thread *tileLoader;
+static SDL_mutex *tileLock;
+/* Set by the loader when it's done, guarded by tileLock */
+static bool tilesLoaded;
+static double tileLoadStart;
+static double tileLoadEnd;
+
+static int tileLoaderMain(void *)
+{
+    double t0 = timerSeconds();
+    bool ok = loadTiles();
+    SDL_LockMutex(tileLock);
+    tilesLoaded = true;
+    tileLoadStart = t0;
+    tileLoadEnd = timerSeconds();
+    SDL_UnlockMutex(tileLock);
+    return ok;
+}
+
+static void startTileLoader()
+{
+    tileLock = SDL_CreateMutex();
+    tileLoader = SDL_CreateThread(tileLoaderMain, NULL);
+    if (!tileLoader)
+    {
+        LOGW(LOG_RENDER, "could not start tile loader thread: %s\n", SDL_GetError());
+        tileLoaderMain(NULL);
+    }
+}
+
+/* Upload the tile set once the loader has it. Returns true once the tiles
+ * are ready to draw with, or sets quit if they couldn't be loaded. */
+static bool pollTiles()
+{
+    static bool ready = false;
+    if (ready)
+        return true;
+
+    SDL_LockMutex(tileLock);
+    bool loaded = tilesLoaded;
+    SDL_UnlockMutex(tileLock);
+    if (!loaded)
+        return false;
+
+    if (tileLoader)
+        SDL_WaitThread(tileLoader, NULL);
+    tileLoader = NULL;
+    startupSpan("tile atlas load (background)", tileLoadStart, tileLoadEnd);
+    if (!tileAtlas)
+    {
+        conPrint("could not load the tile set\n");
+        quit = 1;
+        return false;
+    }
+
+    double t0 = timerSeconds();
+    glRenderer.uploadAtlas(*tileAtlas);
+    glFinish();
+    startupSpan("tile atlas upload", t0, timerSeconds());
+    conPrint("tile atlas: ready %.1f ms after startup\n", startupElapsed() * 1000);
+    ready = true;
+    return true;
+}
+
+/* ld26 --bench-render <frames> <map>...
+ *
+ * Render each map for the given number of frames with the SoftRenderer, with
+ * no window or GL context, and report tiles/sec, the frame time distribution
+ * and a checksum of the last frame. Checksum lines look like
+ *
+ *   checksum <map> <hex>
+ *
+ * so that scripts can compare them against known-good renders. */
+static int benchRender(int argc, char **argv)
+{
+    if (argc < 4)
+    {
+        printf("usage: %s --bench-render <frames> <map>...\n", argv[0]);
+        return 1;
+    }
+    int frames = atoi(argv[2]);
+    if (frames <= 0)
+        frames = 1;
+
+    if (SDL_Init(0) < 0 || !loadTiles())
+        return 1;
+
+    SoftRenderer soft(tileAtlas->level[0], tileAtlas->width, tileAtlas->height);
+    renderer = &soft;
+    Game::Init();
+
+    int rc = 0;
+    vector<double> frameTimes(frames);
+    for (int m=3; m<argc; m++)
+    {
+        if (!Game :: LoadMap(argv[m]))
+        {
+            rc = 1;
+            continue;
+        }
+
+        long long tiles = 0;
+        double t0 = timerSeconds();
+        for (int i=0; i<frames; i++)
+        {
+            double t = timerSeconds();
+            Game :: Draw(1);
+            frameTimes[i] = timerSeconds() - t;
+            tiles += Game :: TilesSubmitted();
+        }
+        double total = timerSeconds() - t0;
+
+        sort(frameTimes.begin(), frameTimes.end());
+        printf("map %s: %d frames in %.3f s, %.0f tiles/s\n", argv[m], frames, total, tiles / total);
+        printf("  frame ms: p50 %.3f  p95 %.3f  p99 %.3f  max %.3f\n",
+                frameTimes[frames * 50 / 100] * 1000, frameTimes[frames * 95 / 100] * 1000,
+                frameTimes[frames * 99 / 100] * 1000, frameTimes[frames - 1] * 1000);
+        printf("checksum %s %08x\n", argv[m], (unsigned int)soft.checksum());
+    }
+
+    SDL_Quit();
+    return rc;
+}
+
+/* Everything the main loop feeds the game goes through these, so that it
+ * can be recorded; see input-log.hxx */
+static void gameMouse(int x, int y)
+{
+    recordMouse(x, y);
+    Game :: Mouse(x, y);
+}
+
+static void gameMouseButton(int button, bool down)
+{
+    recordButton(button, down);
+    Game :: MouseButton(button, down);
+}
+
+static void gameKey(int key, bool down)
+{
+    recordKey(key, down);
+    Game :: Key(key, down);
+}
+
+static void printFrameTimes(const char *what, vector<double>& times)
+{
+    if (times.empty())
+        return;
+    sort(times.begin(), times.end());
+    size_t n = times.size();
+    printf("  %s frame ms: p50 %.3f  p95 %.3f  p99 %.3f  max %.3f\n", what,
+            times[n * 50 / 100] * 1000, times[n * 95 / 100] * 1000,
+            times[n * 99 / 100] * 1000, times[n - 1] * 1000);
+}
+
+/* ld26 --replay <log> [--threads <n>]
+ *
+ * Play an input log made with --record back as fast as it will go, with no
+ * window, drawing with the SoftRenderer, and report the time it took, the
+ * cost of each frame as replayed and as recorded, and the checksum of the
+ * game's state at the end, as
+ *
+ *   checksum <hex>
+ *
+ * Exits with status 1 if the log has a checksum and that isn't it. Autosave
+ * isn't started, and commands that would write files or need GL are skipped
+ * (see skippedInReplay()), so a replay never writes anything. */
+static int replay(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        printf("usage: %s --replay <log> [--threads <n>]\n", argv[0]);
+        return 1;
+    }
+    int threads = 0;
+    for (int a=3; a+1<argc; a+=2)
+        if (strcmp(argv[a], "--threads") == 0)
+            threads = atoi(argv[a+1]);
+
+    InputLogReader log;
+    if (!log.open(argv[2]))
+        return 1;
+    if (SDL_Init(0) < 0 || !loadTiles())
+        return 1;
+
+    SoftRenderer soft(tileAtlas->level[0], tileAtlas->width, tileAtlas->height);
+    renderer = &soft;
+    jobStart(threads);
+    ScreenWidth = log.header.width;
+    ScreenHeight = log.header.height;
+    srandom(log.header.seed);
+    Game::Init();
+    replaying = true;
+
+    vector<double> frameTimes, recordedTimes;
+    vector<char> line;
+    long steps = 0;
+    double recorded = 0;
+    double t0 = timerSeconds();
+    double pass = t0;
+    InputEvent e;
+    while (log.next(e))
+    {
+        switch (e.type)
+        {
+            case INPUT_MOUSE:
+                Game :: Mouse(e.a, e.b);
+                break;
+            case INPUT_BUTTON:
+                Game :: MouseButton(e.a, e.b);
+                break;
+            case INPUT_KEY:
+                Game :: Key(e.a, e.b);
+                break;
+            case INPUT_COMMAND:
+                line.assign(e.line.begin(), e.line.end());
+                line.push_back(0);
+                conCB(NULL, &line[0]);
+                break;
+            case INPUT_RESIZE:
+                ScreenWidth = e.a;
+                ScreenHeight = e.b;
+                break;
+            case INPUT_STEPS:
+                for (int i=0; i<e.a; i++)
+                    Game :: Step();
+                steps += e.a;
+                break;
+            case INPUT_FRAME:
+            {
+                float alpha;
+                uint32_t bits = e.a;
+                memcpy(&alpha, &bits, sizeof(alpha));
+                Game :: Draw(alpha);
+                double t = timerSeconds();
+                frameTimes.push_back(t - pass);
+                pass = t;
+                recordedTimes.push_back(e.b / 1e6);
+                recorded += e.b / 1e6;
+                break;
+            }
+        }
+    }
+    double total = timerSeconds() - t0;
+    uint32_t checksum = Game :: Checksum();
+
+    printf("replay %s: %ld steps, %lu frames in %.3f s; recorded frames took %.3f s\n",
+            argv[2], steps, (unsigned long)frameTimes.size(), total, recorded);
+    printFrameTimes("replayed", frameTimes);
+    printFrameTimes("recorded", recordedTimes);
+    printf("checksum %08x\n", (unsigned int)checksum);
+
+    int rc = 0;
+    if (!log.ended)
+        printf("log has no end record; nothing to compare the checksum with\n");
+    else if (log.checksum != checksum)
+    {
+        printf("checksum differs from the recording's %08x\n", (unsigned int)log.checksum);
+        rc = 1;
+    }
+
+    jobStop();
+    SDL_Quit();
+    return rc;
+}
+
 int main(int argc, char **argv)
 {
+    startupBegin();
     bool fs = false;
-    int fps_counter = 0, fps_timer = 0;
-
-    srandom(time(NULL));
+    int fps_counter = 0;
+    double fps_timer = timerSeconds();
+
+    if (argc > 1 && strcmp(argv[1], "--bench-render") == 0)
+        return benchRender(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--replay") == 0)
+        return replay(argc, argv);
+
+    unsigned int seed = time(NULL);
+    srandom(seed);
+
+    const char *logFilename = NULL;
+    const char *recordFilename = NULL;
+    int threads = 0;
+    /* --startup-bench: quit as soon as the first frame with the world in
+     * it has been shown, and print how long getting there took */
+    bool startupBench = false;
+    for (int a=1; a<argc; a++)
+    {
+        if (strcmp(argv[a], "--startup-bench") == 0)
+            startupBench = true;
+        else if (a+1 == argc)
+            break;
+        else if (strcmp(argv[a], "--log") == 0)
+            logFilename = argv[++a];
+        else if (strcmp(argv[a], "--threads") == 0)
+            threads = atoi(argv[++a]);
+        else if (strcmp(argv[a], "--record") == 0)
+            recordFilename = argv[++a];
+    }
 
-    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_JOYSTICK) < 0)
+    // Audio isn't used, and the joystick is only opened when asked for
+    // (see openJoystick()), so only video is brought up here
+    if (SDL_Init(SDL_INIT_VIDEO) < 0)
     {
         printf("SDL_Init error: %s\n", SDL_GetError());
         return 1;
     }
+    startupMark("SDL_Init");
 
-    SDL_Joystick * JS;
-    SDL_JoystickEventState(SDL_ENABLE);
-    JS=SDL_JoystickOpen(0);
+    // Nothing the tile loader does needs the window, so start it first. It
+    // logs, and may only once the log thread is there to take its messages.
+    logStart(logFilename);
+    startupMark("log thread");
+    startTileLoader();
 
     if (fs) video_flags |= SDL_FULLSCREEN;
 
@@ -135,7 +764,7 @@ int main(int argc, char **argv)
         SDL_Quit();
         return 1;
     }
-
+    startupMark("video mode");
 
     SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
     SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 16);
@@ -150,67 +779,42 @@ int main(int argc, char **argv)
 
     OGLCONSOLE_Create();
     OGLCONSOLE_EnterKey(conCB);
-
-    SDL_GL_SwapBuffers();
+    consoleReady = true;
+    startupMark("console");
+    jobStart(threads);
+    autosaveStart();
+    startupMark("job and autosave threads");
 
     glEnable(GL_TEXTURE_2D);
 
-    glGenTextures(1, &tilesTexture);
-    {int err=glGetError();if(err)printf("glGenTextures() error: %i\n",err);}
-
-    glBindTexture(GL_TEXTURE_2D, tilesTexture);
-    {int err=glGetError();if(err)printf("glBindTexture() error: %i\n",err);}
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-    tileSurface = SDL_CreateRGBSurface(0, 512, 512, 32,
-    #if SDL_BYTEORDER == SDL_BIG_ENDIAN
-      0xff000000, 0x00ff0000, 0x0000ff00, 0x000000ff
-    #else
-      0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000
-    #endif
-    );
-
-    if (tileSurface == NULL)
-    {
-      printf("error: SDL_CreateRGBSurface(): %s\n", SDL_GetError());
-      return 1;
-    }
-
-    SDL_Surface *loadTileSurface = SDL_LoadBMP("data/tiles.bmp");
-    if (loadTileSurface == NULL)
-    {
-      OGLCONSOLE_Print("Could not load data/tiles.bmp: %s\n", SDL_GetError());
-    }
-    else
-    {
-      SDL_SetColorKey(loadTileSurface, SDL_SRCCOLORKEY, SDL_MapRGB(loadTileSurface->format, 255, 0, 255));
-      SDL_BlitSurface(loadTileSurface, NULL, tileSurface, NULL);
-      SDL_FreeSurface(loadTileSurface);
-      loadTileSurface = NULL;
-    }
-
-    glTexImage2D(
-            GL_TEXTURE_2D, 0, GL_RGB,
-            512, 512, 0,
-            GL_RGBA, GL_UNSIGNED_BYTE, tileSurface->pixels);
-
-    int next_expected_frame_time = 0;
     bool cursorHidden = false;
 
+    /* Mouse motion is coalesced into one update per pass of the main loop,
+     * so that a fast drag costs the same as a slow one */
+    bool mouseMoved = false;
+    int mouseX = 0, mouseY = 0;
+
+    if (recordFilename)
+        recordStart(recordFilename, seed, ScreenWidth, ScreenHeight, scheduler.tickRate);
     Game::Init();
+    startupMark("game init");
+    scheduler.reset(timerSeconds());
+    bool firstPresent = true;
+    bool tilesShown = false;
 
     while (!quit)
     {
+        double passStart = timerSeconds();
+        PERF_BEGIN(eventsScope, PERF_EVENTS);
         while (SDL_PollEvent(&event))
         {
             switch (event.type)
             {
                 case SDL_VIDEORESIZE:
-                    printf("video resize %dx%d\n", event.resize.w, event.resize.h);
+                    LOGI(LOG_RENDER, "video resize %dx%d\n", event.resize.w, event.resize.h);
                     ScreenWidth = event.resize.w;
                     ScreenHeight = event.resize.h;
+                    recordResize(ScreenWidth, ScreenHeight);
                     SDL_SetVideoMode
                         (ScreenWidth, ScreenHeight, 32, video_flags);
                     glViewport(0, 0, ScreenWidth, ScreenHeight);
@@ -239,12 +843,21 @@ int main(int argc, char **argv)
             switch (event.type)
             {
                 case SDL_MOUSEMOTION:
-                    Game :: Mouse(event.motion.x, event.motion.y);
+                    mouseMoved = true;
+                    mouseX = event.motion.x;
+                    mouseY = event.motion.y;
                     break;
 
                 case SDL_MOUSEBUTTONDOWN:
                 case SDL_MOUSEBUTTONUP:
-                    Game :: MouseButton(event.button.button, event.button.state);
+                    // The button acts wherever the cursor was when it was
+                    // pressed, so catch up on any motion before it
+                    if (mouseMoved)
+                    {
+                        gameMouse(mouseX, mouseY);
+                        mouseMoved = false;
+                    }
+                    gameMouseButton(event.button.button, event.button.state);
                     break;
 
                 case SDL_KEYDOWN:
@@ -258,8 +871,8 @@ int main(int argc, char **argv)
                     // TODO: Change this into an FPS display toggle?
                     else if (event.key.keysym.sym == SDLK_f)
                     {
-                        int t = SDL_GetTicks();
-                        double seconds = (t - fps_timer) / 1000.0;
+                        double t = timerSeconds();
+                        double seconds = t - fps_timer;
                         double fps = fps_counter / seconds;
 
                         OGLCONSOLE_Print("%d frames in %g seconds = %g FPS\n",
@@ -272,53 +885,87 @@ int main(int argc, char **argv)
                 
                 // pass through
                 case SDL_KEYUP:
-                    Game::Key(event.key.keysym.sym, event.type == SDL_KEYDOWN);
+                    gameKey(event.key.keysym.sym, event.type == SDL_KEYDOWN);
                     break;
             }
 
             if (event.type == SDL_QUIT)
                 quit = 1;
         }
+        if (mouseMoved)
+        {
+            gameMouse(mouseX, mouseY);
+            mouseMoved = false;
+        }
+        PERF_END(eventsScope);
+        logPump();
 
-        // Tick game progress
-        //Game :: Step();
+        // Tick game progress at a fixed rate, catching up if we fell behind
+        double t = timerSeconds();
+        int steps = 0;
+        while (scheduler.tickDue(t))
+        {
+            PERF_SCOPE(PERF_STEP);
+            Game :: Step();
+            steps++;
+        }
+        recordSteps(steps);
 
-        // If the current time is past the desired frame time, then we skip this
-        // frame
-        int t = SDL_GetTicks();
-        if (t < next_expected_frame_time)
+        // Render at most FPS times per second; missed frames are counted by
+        // the scheduler rather than made up
+        if (scheduler.frameDue(t))
         {
             // Render the screen
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-            Game :: Draw();
-            OGLCONSOLE_Draw();
-
-            // If the current time is before the desired frame time, then we
-            // choke our performance here with a delay
-            int u = SDL_GetTicks();
-            if (u < next_expected_frame_time)
-                // TODO: Put some kind of offset in here?
-                SDL_Delay(next_expected_frame_time - u);
-
-            // Determine the next expected frame time
-            next_expected_frame_time += 1000 / FPS;
+            double alpha = scheduler.alpha(t);
+            // Until the tile set is in, frames show just the console
+            bool tilesReady = pollTiles();
+            if (tilesReady)
+                Game :: Draw(alpha);
+            {
+                PERF_SCOPE(PERF_CONSOLE_DRAW);
+                OGLCONSOLE_Draw();
+            }
 
             // Flip screen buffers
-            SDL_GL_SwapBuffers();
-        }
-        else
-        {
-            // Perhaps some diagnostic output should be made available here?
-            // cout << "Below 60 FPS" << endl;
+            {
+                PERF_SCOPE(PERF_SWAP);
+                SDL_GL_SwapBuffers();
+            }
+            fps_counter++;
+            recordFrame(alpha, timerSeconds() - passStart);
 
-            // Determine the next expected frame time
-            next_expected_frame_time += 1000 / FPS;
+            if (firstPresent)
+            {
+                startupMark(tilesReady ? "first frame" : "first frame, console only");
+                firstPresent = false;
+                tilesShown = tilesReady;
+            }
+            else if (tilesReady && !tilesShown)
+            {
+                startupMark("waiting for tiles, then first frame with them");
+                tilesShown = true;
+            }
+            if (tilesShown && startupBench)
+            {
+                startupReport(false);
+                quit = 1;
+            }
         }
 
-
-        fps_counter++;
+        // Sleep until the next tick or frame is due, waking a little early
+        // since SDL_Delay() tends to oversleep
+        double idle = scheduler.idleTime(timerSeconds());
+        if (idle > 0.002)
+            timerSleep(idle - 0.001);
     }
 
+    recordStop(Game :: Checksum());
+    if (tileLoader)
+        SDL_WaitThread(tileLoader, NULL);
+    autosaveStop();
+    jobStop();
+    logStop();
     OGLCONSOLE_Quit();
     //Game :: Quit();
     //Sound :: Quit();
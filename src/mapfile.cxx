@@ -0,0 +1,429 @@
+#include "log.hxx"
+#include "mapfile.hxx"
+#include "tile-raft.hxx"
+#include "tileset.hxx"
+#include "rle.hxx"
+#include "arena.hxx"
+#include "job-pool.hxx"
+#include <limits.h>
+#include <string.h>
+#include <fstream>
+#include <new>
+using namespace std;
+
+uint32_t mapChecksum(const unsigned char *data, size_t len, uint32_t adler)
+{
+  uint32_t a = adler & 0xffff;
+  uint32_t b = adler >> 16;
+  while (len)
+  {
+    /* 5552 is the most bytes we can sum before b could overflow */
+    size_t n = len < 5552 ? len : 5552;
+    len -= n;
+    while (n--)
+    {
+      a += *data++;
+      b += a;
+    }
+    a %= 65521;
+    b %= 65521;
+  }
+  return (b << 16) | a;
+}
+
+static uint64_t alignUp(uint64_t n)
+{
+  return (n + MAPFILE_ALIGN - 1) / MAPFILE_ALIGN * MAPFILE_ALIGN;
+}
+
+MapFile::MapFile() :
+  data(NULL),
+  size(0),
+  header(NULL),
+  table(NULL)
+{
+}
+
+bool MapFile::detect(string filename)
+{
+  char magic[8];
+  ifstream f(filename.c_str(), ios::in | ios::binary);
+  f.read(magic, sizeof(magic));
+  return f && memcmp(magic, MAPFILE_MAGIC, sizeof(magic)) == 0;
+}
+
+MapFile *MapFile::open(string filename)
+{
+  MapFile *file = new MapFile;
+  file->filename = filename;
+
+  if (file->file.open(filename))
+  {
+    file->data = file->file.data;
+    file->size = file->file.size;
+  }
+
+  if (!file->data)
+  {
+    LOGW(LOG_MAP, "could not read map file \"%s\"\n", filename.c_str());
+    delete file;
+    return NULL;
+  }
+
+  /* Validate everything we can without touching the tile blocks */
+  const char *error = NULL;
+  file->header = (const MapFileHeader*)file->data;
+  file->table = (const MapFileRaft*)(file->data + sizeof(MapFileHeader));
+  const MapFileHeader *h = file->header;
+
+  if (file->size < sizeof(MapFileHeader)
+  ||  memcmp(h->magic, MAPFILE_MAGIC, sizeof(h->magic)) != 0)
+    error = "not a binary map file";
+  else if (h->bom != MAPFILE_BOM)
+    error = "written on a machine of different endianness";
+  else if (h->version != MAPFILE_VERSION)
+    error = "unsupported version";
+  else if (h->nrafts > (file->size - sizeof(MapFileHeader)) / sizeof(MapFileRaft))
+    error = "truncated raft table";
+  else if (mapChecksum((const unsigned char*)file->table, h->nrafts * sizeof(MapFileRaft)) != h->tableChecksum)
+    error = "raft table checksum mismatch";
+  else
+  {
+    for (uint32_t i=0; i<h->nrafts && !error; i++)
+    {
+      const MapFileRaft& r = file->table[i];
+      /* The game works rafts' sizes out in pixels, and their chunk counts,
+       * as ints; nothing it couldn't is let in */
+      if (r.width < 0 || r.height < 0 || r.width > INT_MAX / TILESIZE || r.height > INT_MAX / TILESIZE)
+      {
+        error = "bad raft dimensions";
+        break;
+      }
+      uint64_t chunks = (uint64_t)((r.width  + CHUNKSIZE - 1) / CHUNKSIZE)
+                                * ((r.height + CHUNKSIZE - 1) / CHUNKSIZE);
+      if (chunks > INT_MAX)
+        error = "bad raft dimensions";
+      else if (r.offset % MAPFILE_ALIGN || r.offset > file->size || r.size > file->size - r.offset)
+        error = "raft tile block out of bounds";
+      else if (r.encoding != MAPFILE_RAW && r.encoding != MAPFILE_RLE)
+        error = "unknown raft encoding";
+      else if (r.encoding == MAPFILE_RAW && r.size != chunks * CHUNKSIZE * CHUNKSIZE)
+        error = "raft tile block has the wrong size";
+    }
+  }
+
+  if (error)
+  {
+    LOGW(LOG_MAP, "bad map file \"%s\": %s\n", filename.c_str(), error);
+    delete file;
+    return NULL;
+  }
+
+  return file;
+}
+
+TileRaft *MapFile::makeRaft(int i, Arena *arena)
+{
+  const MapFileRaft& r = table[i];
+  TileRaft *raft;
+  if (arena)
+    raft = new (arena->alloc(sizeof(TileRaft))) TileRaft(this, i, r.width, r.height, arena);
+  else
+    raft = new TileRaft(this, i, r.width, r.height);
+  raft->xOff = r.xOff;
+  raft->yOff = r.yOff;
+  return raft;
+}
+
+void MapFile::page(TileRaft& raft, int i)
+{
+  const MapFileRaft& r = table[i];
+  unsigned char *block = data + r.offset;
+
+  if (mapChecksum(block, r.size) != r.checksum)
+  {
+    /* Leave the raft blank rather than show garbage */
+    LOGE(LOG_MAP, "map file \"%s\": raft %d checksum mismatch\n", filename.c_str(), i);
+    return;
+  }
+
+  if (r.encoding == MAPFILE_RLE)
+  {
+    if (!decodeRaft(raft, block, r.size))
+      LOGE(LOG_MAP, "map file \"%s\": raft %d is corrupt\n", filename.c_str(), i);
+    return;
+  }
+
+  /* Chunks read their tiles straight out of the mapping. Blank chunks are
+   * left unallocated, as they would be in a raft built by hand. */
+  static const unsigned char zeros[CHUNKSIZE*CHUNKSIZE] = {0};
+  for (size_t c=0; c<raft.chunks.size(); c++)
+  {
+    unsigned char *tiles = block + c * CHUNKSIZE*CHUNKSIZE;
+    if (memcmp(tiles, zeros, CHUNKSIZE*CHUNKSIZE) != 0)
+      raft.chunks[c] = raft.newChunk(tiles);
+  }
+}
+
+bool MapFile::readChunks(int i, void (*fn)(void *fnData, int c, const unsigned char *tiles), void *fnData)
+{
+  const MapFileRaft& r = table[i];
+  const unsigned char *block = data + r.offset;
+  int chunks = ((r.width + CHUNKSIZE - 1) / CHUNKSIZE) * ((r.height + CHUNKSIZE - 1) / CHUNKSIZE);
+
+  if (mapChecksum(block, r.size) != r.checksum)
+  {
+    LOGE(LOG_MAP, "map file \"%s\": raft %d checksum mismatch\n", filename.c_str(), i);
+    return false;
+  }
+
+  if (r.encoding == MAPFILE_RAW)
+  {
+    static const unsigned char zeros[CHUNKSIZE*CHUNKSIZE] = {0};
+    for (int c=0; c<chunks; c++)
+    {
+      const unsigned char *tiles = block + (size_t)c * CHUNKSIZE*CHUNKSIZE;
+      fn(fnData, c, memcmp(tiles, zeros, CHUNKSIZE*CHUNKSIZE) ? tiles : NULL);
+    }
+    return true;
+  }
+
+  RleDecoder rle(block, r.size);
+  unsigned char tiles[CHUNKSIZE*CHUNKSIZE];
+  for (int c=0; c<chunks; c++)
+  {
+    if (rle.skipRun(0, CHUNKSIZE*CHUNKSIZE))
+      fn(fnData, c, NULL);
+    else if (rle.read(tiles, CHUNKSIZE*CHUNKSIZE))
+      fn(fnData, c, tiles);
+    else
+      break;
+  }
+  if (!rle.done())
+  {
+    LOGE(LOG_MAP, "map file \"%s\": raft %d is corrupt\n", filename.c_str(), i);
+    return false;
+  }
+  return true;
+}
+
+void MapFile::encodeRaft(const TileRaft& raft, vector<unsigned char>& out)
+{
+  RleEncoder rle(out);
+  for (int cy=0; cy<raft.chunksH; cy++)
+  for (int cx=0; cx<raft.chunksW; cx++)
+  {
+    TileChunk *c = raft.chunk(cx, cy);
+    if (c)
+      rle.put(c->tiles, CHUNKSIZE*CHUNKSIZE);
+    else
+      rle.putRun(0, CHUNKSIZE*CHUNKSIZE);
+  }
+  rle.finish();
+}
+
+bool MapFile::writeEncoded(string filename, vector<MapFileRaft>& table,
+                           const vector< vector<unsigned char> >& blocks,
+                           uint64_t& written)
+{
+  static const unsigned char zeros[MAPFILE_ALIGN] = {0};
+  MapFileHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, MAPFILE_MAGIC, sizeof(h.magic));
+  h.bom = MAPFILE_BOM;
+  h.version = MAPFILE_VERSION;
+  h.nrafts = table.size();
+
+  uint64_t offset = alignUp(sizeof(h) + table.size() * sizeof(MapFileRaft));
+  for (size_t i=0; i<table.size(); i++)
+  {
+    MapFileRaft& r = table[i];
+    r.offset = offset;
+    r.size = blocks[i].size();
+    r.encoding = MAPFILE_RLE;
+    r.checksum = mapChecksum(blocks[i].empty() ? NULL : &blocks[i][0], r.size);
+    offset = alignUp(offset + r.size);
+  }
+  if (table.size())
+    h.tableChecksum = mapChecksum((const unsigned char*)&table[0], table.size() * sizeof(MapFileRaft));
+  else
+    h.tableChecksum = mapChecksum(NULL, 0);
+
+  AtomicFile f;
+  f.open(filename);
+  f.write(&h, sizeof(h));
+  if (table.size())
+    f.write(&table[0], table.size() * sizeof(MapFileRaft));
+  for (size_t i=0; i<table.size() && f.ok; i++)
+  {
+    f.write(zeros, table[i].offset - f.written);
+    if (!blocks[i].empty())
+      f.write(&blocks[i][0], blocks[i].size());
+  }
+
+  written = f.written;
+  if (!f.commit())
+  {
+    LOGE(LOG_MAP, "error writing map file \"%s\"\n", filename.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool MapFile::decodeRaft(TileRaft& raft, const unsigned char *block, size_t size)
+{
+  RleDecoder rle(block, size);
+  for (size_t c=0; c<raft.chunks.size(); c++)
+  {
+    /* Blank chunks are left unallocated */
+    if (rle.skipRun(0, CHUNKSIZE*CHUNKSIZE))
+      continue;
+
+    raft.chunks[c] = raft.newChunk();
+    if (!rle.read(raft.chunks[c]->tiles, CHUNKSIZE*CHUNKSIZE))
+      break;
+  }
+
+  if (!rle.done())
+  {
+    for (size_t c=0; c<raft.chunks.size(); c++)
+    {
+      raft.freeChunk(raft.chunks[c]);
+      raft.chunks[c] = NULL;
+    }
+    return false;
+  }
+  return true;
+}
+
+/* Encode and checksum rafts for MapFile :: write() */
+struct EncodeJob {
+  TileRaft *const *rafts;
+  MapFileRaft *table;
+  vector<unsigned char> *encoded;
+  bool compress;
+};
+
+static void encodeBlocks(void *data, int begin, int end)
+{
+  static const unsigned char zeros[CHUNKSIZE*CHUNKSIZE] = {0};
+  EncodeJob& job = *(EncodeJob*)data;
+  for (int i=begin; i<end; i++)
+  {
+    const TileRaft *raft = job.rafts[i];
+    MapFileRaft& r = job.table[i];
+    vector<unsigned char>& encoded = job.encoded[i];
+    r.size = (uint64_t)raft->chunksW * raft->chunksH * CHUNKSIZE*CHUNKSIZE;
+    r.encoding = MAPFILE_RAW;
+
+    if (job.compress)
+    {
+      MapFile::encodeRaft(*raft, encoded);
+      if (encoded.size() < r.size)
+      {
+        r.size = encoded.size();
+        r.encoding = MAPFILE_RLE;
+      }
+      else
+        vector<unsigned char>().swap(encoded);
+    }
+
+    if (r.encoding == MAPFILE_RLE)
+      r.checksum = mapChecksum(&encoded[0], r.size);
+    else
+    {
+      r.checksum = 1;
+      for (int cy=0; cy<raft->chunksH; cy++)
+      for (int cx=0; cx<raft->chunksW; cx++)
+      {
+        TileChunk *c = raft->chunk(cx, cy);
+        r.checksum = mapChecksum(c ? c->tiles : zeros, CHUNKSIZE*CHUNKSIZE, r.checksum);
+      }
+    }
+  }
+}
+
+bool MapFile::write(string filename, const vector<TileRaft*>& rafts, bool compress)
+{
+  MapFileHeader h;
+  vector<MapFileRaft> table(rafts.size());
+  vector< vector<unsigned char> > encoded(rafts.size());
+  static const unsigned char zeros[CHUNKSIZE*CHUNKSIZE] = {0};
+
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, MAPFILE_MAGIC, sizeof(h.magic));
+  h.bom = MAPFILE_BOM;
+  h.version = MAPFILE_VERSION;
+  h.nrafts = rafts.size();
+
+  /* Fill in the table, except for the offsets, encoding and checksumming
+   * the rafts on the job pool. Paging a raft in may allocate from an arena,
+   * so that is done here first. */
+  for (size_t i=0; i<rafts.size(); i++)
+  {
+    const TileRaft *raft = rafts[i];
+    MapFileRaft& r = table[i];
+    memset(&r, 0, sizeof(r));
+    r.width = raft->width;
+    r.height = raft->height;
+    r.xOff = raft->xOff;
+    r.yOff = raft->yOff;
+    if (raft->source)
+      raft->page();
+  }
+  if (!rafts.empty())
+  {
+    EncodeJob job = { &rafts[0], &table[0], &encoded[0], compress };
+    parallelFor(rafts.size(), 1, encodeBlocks, &job);
+  }
+
+  /* Lay out the tile blocks */
+  uint64_t offset = alignUp(sizeof(h) + table.size() * sizeof(MapFileRaft));
+  for (size_t i=0; i<table.size(); i++)
+  {
+    table[i].offset = offset;
+    offset = alignUp(offset + table[i].size);
+  }
+  if (table.size())
+    h.tableChecksum = mapChecksum((const unsigned char*)&table[0], table.size() * sizeof(MapFileRaft));
+  else
+    h.tableChecksum = mapChecksum(NULL, 0);
+
+  AtomicFile f;
+  f.open(filename);
+  f.write(&h, sizeof(h));
+  if (table.size())
+    f.write(&table[0], table.size() * sizeof(MapFileRaft));
+
+  for (size_t i=0; i<rafts.size() && f.ok; i++)
+  {
+    const TileRaft *raft = rafts[i];
+
+    /* Pad up to the block's offset */
+    while (f.written < table[i].offset && f.ok)
+    {
+      uint64_t n = table[i].offset - f.written;
+      f.write(zeros, n < sizeof(zeros) ? n : sizeof(zeros));
+    }
+
+    if (table[i].encoding == MAPFILE_RLE)
+    {
+      f.write(&encoded[i][0], encoded[i].size());
+      continue;
+    }
+
+    for (int cy=0; cy<raft->chunksH; cy++)
+    for (int cx=0; cx<raft->chunksW; cx++)
+    {
+      TileChunk *c = raft->chunk(cx, cy);
+      f.write(c ? c->tiles : zeros, CHUNKSIZE*CHUNKSIZE);
+    }
+  }
+
+  if (!f.commit())
+  {
+    LOGE(LOG_MAP, "error writing map file \"%s\"\n", filename.c_str());
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,116 @@
+#ifndef MAPFILE_HXX
+#define MAPFILE_HXX
+#include "mapped-file.hxx"
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+struct TileRaft;
+struct Arena;
+
+/* Binary map files
+ *
+ * A binary map file starts with a MapFileHeader, followed by a table of
+ * nrafts MapFileRaft entries. Each raft's tiles are stored in a block of
+ * their own, starting on a MAPFILE_ALIGN boundary, so that the file can be
+ * mapped into memory and the tiles read in place. A raw block holds the
+ * raft's chunks in row-major order, each chunk being CHUNKSIZE*CHUNKSIZE
+ * tiles; an RLE block is the same data run-length encoded (see rle.hxx). All fields are stored in the host's byte order; MAPFILE_BOM lets a
+ * reader detect a file written on a machine of the other endianness.
+ *
+ * Old text maps begin with "LD26____MAPFILE" instead of MAPFILE_MAGIC, so the
+ * two formats can be told apart by their first bytes.
+ */
+#define MAPFILE_MAGIC "LD26BMAP"
+#define MAPFILE_VERSION 1
+#define MAPFILE_BOM 0x01020304
+#define MAPFILE_ALIGN 4096
+
+/* Encodings of a raft's tile block */
+#define MAPFILE_RAW 0
+#define MAPFILE_RLE 1
+
+struct MapFileHeader {
+  char magic[8];
+  uint32_t bom;
+  uint32_t version;
+  uint32_t nrafts;
+  /* mapChecksum() of the raft table */
+  uint32_t tableChecksum;
+  uint32_t reserved[2];
+};
+
+struct MapFileRaft {
+  int32_t width;
+  int32_t height;
+  int32_t xOff;
+  int32_t yOff;
+  /* Location of the tile block, from the start of the file */
+  uint64_t offset;
+  uint64_t size;
+  /* mapChecksum() of the tile block */
+  uint32_t checksum;
+  uint32_t encoding;
+};
+
+/* Adler-32 */
+uint32_t mapChecksum(const unsigned char *data, size_t len, uint32_t adler=1);
+
+/* An open binary map file. It stays mapped for as long as any raft created
+ * by makeRaft() may still be paged in, i.e. for the life of their World. */
+struct MapFile {
+  std::string filename;
+  MappedFile file;
+  unsigned char *data;
+  size_t size;
+  const MapFileHeader *header;
+  const MapFileRaft *table;
+
+  /* Map and validate a file. Returns NULL, having printed why, if it is not
+   * a valid binary map file. */
+  static MapFile *open(std::string filename);
+
+  /* True if the file starts with MAPFILE_MAGIC */
+  static bool detect(std::string filename);
+
+  /* Write rafts to a binary map file, returning false on any I/O error. The
+   * file is replaced atomically. If compress is set, rafts that get smaller
+   * for it are RLE encoded. */
+  static bool write(std::string filename, const std::vector<TileRaft*>& rafts, bool compress=true);
+
+  /* Write a binary map file whose tile blocks are already RLE encoded, e.g.
+   * a chunk at a time by the autosaver. Only the size and position of each
+   * raft need be filled in in table; the rest is done here. Returns false on
+   * any I/O error, and otherwise sets written to the file's size. */
+  static bool writeEncoded(std::string filename, std::vector<MapFileRaft>& table,
+                           const std::vector< std::vector<unsigned char> >& blocks,
+                           uint64_t& written);
+
+  /* RLE encode a raft's chunks, as stored in an MAPFILE_RLE block */
+  static void encodeRaft(const TileRaft& raft, std::vector<unsigned char>& out);
+
+  /* Fill raft's chunks from an MAPFILE_RLE block. Returns false, leaving
+   * the raft blank, if the block is corrupt. */
+  static bool decodeRaft(TileRaft& raft, const unsigned char *block, size_t size);
+
+  /* A raft for table entry i, which won't be read until it is used. If
+   * arena is given, the raft and its chunks are allocated from it. */
+  TileRaft *makeRaft(int i, Arena *arena=NULL);
+
+  /* Point raft's chunks at table entry i's tile block. Called by
+   * TileRaft :: page() the first time the raft's tiles are needed. */
+  void page(TileRaft& raft, int i);
+
+  /* Call fn(fnData, c, tiles) for each chunk c of table entry i's tile
+   * block in turn, with tiles NULL for a blank chunk, for reading a raft
+   * without paging it in. Returns false, having logged why, if the block is
+   * corrupt, possibly after some calls. */
+  bool readChunks(int i, void (*fn)(void *fnData, int c, const unsigned char *tiles), void *fnData);
+
+private:
+  MapFile();
+  MapFile(const MapFile &);
+  MapFile & operator=(const MapFile &);
+};
+#endif
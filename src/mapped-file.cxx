@@ -0,0 +1,142 @@
+#include "mapped-file.hxx"
+#include <stdio.h>
+#include <stdlib.h>
+#ifndef _WIN32
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+using namespace std;
+
+MappedFile::MappedFile() :
+  data(NULL),
+  size(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+  close();
+}
+
+void MappedFile::close()
+{
+  if (!data)
+    return;
+#ifdef _WIN32
+  free(data);
+#else
+  munmap(data, size);
+#endif
+  data = NULL;
+  size = 0;
+}
+
+bool MappedFile::open(string filename)
+{
+  close();
+
+#ifdef _WIN32
+  FILE *f = fopen(filename.c_str(), "rb");
+  if (!f)
+    return false;
+  fseek(f, 0, SEEK_END);
+  long n = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  if (n > 0)
+  {
+    data = (unsigned char*)malloc(n);
+    size = n;
+    if (fread(data, 1, size, f) != size)
+      close();
+  }
+  fclose(f);
+#else
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size > 0)
+  {
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED)
+    {
+      data = (unsigned char*)p;
+      size = st.st_size;
+    }
+  }
+  ::close(fd);
+#endif
+
+  return data != NULL;
+}
+
+AtomicFile::AtomicFile() :
+  f(NULL),
+  ok(false),
+  written(0)
+{
+}
+
+AtomicFile::~AtomicFile()
+{
+  discard();
+}
+
+bool AtomicFile::open(string filename_)
+{
+  discard();
+  filename = filename_;
+  tmpFilename = filename + ".tmp";
+  f = fopen(tmpFilename.c_str(), "wb");
+  ok = f != NULL;
+  written = 0;
+  return ok;
+}
+
+bool AtomicFile::write(const void *data, size_t size)
+{
+  if (ok && fwrite(data, 1, size, f) != size)
+    ok = false;
+  written += size;
+  return ok;
+}
+
+bool AtomicFile::commit()
+{
+  if (!f)
+    return false;
+
+  if (fflush(f) != 0)
+    ok = false;
+#ifndef _WIN32
+  if (ok && fsync(fileno(f)) != 0)
+    ok = false;
+#endif
+  if (fclose(f) != 0)
+    ok = false;
+  f = NULL;
+
+#ifdef _WIN32
+  /* rename() won't replace an existing file on Windows */
+  if (ok)
+    remove(filename.c_str());
+#endif
+  if (!ok || rename(tmpFilename.c_str(), filename.c_str()) != 0)
+  {
+    remove(tmpFilename.c_str());
+    ok = false;
+  }
+  return ok;
+}
+
+void AtomicFile::discard()
+{
+  if (!f)
+    return;
+  fclose(f);
+  f = NULL;
+  remove(tmpFilename.c_str());
+  ok = false;
+}
@@ -0,0 +1,50 @@
+#ifndef MAPPED_FILE_HXX
+#define MAPPED_FILE_HXX
+#include <stddef.h>
+#include <stdio.h>
+#include <string>
+
+/* A whole file mapped read-only into memory. Where mmap() isn't available
+ * the file is read into a buffer instead, which looks the same to callers. */
+struct MappedFile {
+  unsigned char *data;
+  size_t size;
+
+  MappedFile();
+  ~MappedFile();
+
+  /* Returns false if the file can't be opened or is empty */
+  bool open(std::string filename);
+  void close();
+
+private:
+  MappedFile(const MappedFile &);
+  MappedFile & operator=(const MappedFile &);
+};
+
+/* A file written atomically: data goes to a temporary file which commit()
+ * syncs and renames over the real one, so that readers (or the next run,
+ * after a crash) see either the old file or the new one, never a partial
+ * write. Errors are sticky; commit() returns false if anything failed. A file
+ * destroyed without being committed is discarded. */
+struct AtomicFile {
+  std::string filename;
+  std::string tmpFilename;
+  FILE *f;
+  bool ok;
+  /* Bytes written so far */
+  size_t written;
+
+  AtomicFile();
+  ~AtomicFile();
+
+  bool open(std::string filename);
+  bool write(const void *data, size_t size);
+  bool commit();
+  void discard();
+
+private:
+  AtomicFile(const AtomicFile &);
+  AtomicFile & operator=(const AtomicFile &);
+};
+#endif
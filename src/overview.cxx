@@ -0,0 +1,233 @@
+#include "overview.hxx"
+#include "mapfile.hxx"
+#include <string.h>
+#include <algorithm>
+
+using namespace std;
+
+/* Chunk overviews are CHUNKSIZE texels a side, so a page holds SLOTS*SLOTS */
+#define SLOTS (OVERVIEW_PAGE / CHUNKSIZE)
+
+int lodForZoom(double zoom)
+{
+  if (zoom >= LOD_TILES_MINZOOM)
+    return LOD_TILES;
+  if (zoom >= LOD_CHUNKS_MINZOOM)
+    return LOD_CHUNKS;
+  return LOD_RAFTS;
+}
+
+/* Sums the channels of RGBA texels, to average them */
+struct ColorSum {
+  unsigned long c[4];
+  unsigned long n;
+
+  ColorSum() : n(0) { c[0] = c[1] = c[2] = c[3] = 0; }
+
+  void add(uint32_t texel)
+  {
+    const unsigned char *b = (const unsigned char*)&texel;
+    c[0] += b[0]; c[1] += b[1]; c[2] += b[2]; c[3] += b[3];
+    n++;
+  }
+
+  uint32_t average() const
+  {
+    uint32_t texel = 0;
+    if (!n)
+      return texel;
+    unsigned char *b = (unsigned char*)&texel;
+    for (int i=0; i<4; i++)
+      b[i] = (c[i] + n / 2) / n;
+    return texel;
+  }
+};
+
+void tileColors(const uint32_t *atlas, int atlasWidth, int atlasHeight, uint32_t colors[256])
+{
+  for (int tile=0; tile<256; tile++)
+  {
+    int x0 = tile % TILESETW * TILESIZE;
+    int y0 = tile / TILESETW * TILESIZE;
+    ColorSum sum;
+    for (int y=y0; y<y0+TILESIZE && y<atlasHeight; y++)
+    for (int x=x0; x<x0+TILESIZE && x<atlasWidth; x++)
+      sum.add(atlas[y * atlasWidth + x]);
+    colors[tile] = sum.average();
+  }
+}
+
+void chunkOverview(const TileChunk *chunk, const uint32_t colors[256], uint32_t *out)
+{
+  for (int i=0; i<CHUNKSIZE*CHUNKSIZE; i++)
+    out[i] = colors[chunk ? chunk->tiles[i] : 0];
+}
+
+uint32_t chunkColor(TileChunk *chunk, const uint32_t colors[256])
+{
+  if (!chunk)
+    return colors[0];
+  if (chunk->colorRevision != chunk->revision)
+  {
+    ColorSum sum;
+    for (int i=0; i<CHUNKSIZE*CHUNKSIZE; i++)
+      sum.add(colors[chunk->tiles[i]]);
+    chunk->color = sum.average();
+    chunk->colorRevision = chunk->revision;
+  }
+  return chunk->color;
+}
+
+/* Collects the colors of chunks read out of a map file, for raftOverview() */
+struct SourceColors {
+  const uint32_t *colors;
+  vector<uint32_t> *out;
+};
+
+static void sourceChunkColor(void *data, int c, const unsigned char *tiles)
+{
+  SourceColors& sc = *(SourceColors*)data;
+  if (!tiles)
+    return;
+  ColorSum sum;
+  for (int i=0; i<CHUNKSIZE*CHUNKSIZE; i++)
+    sum.add(sc.colors[tiles[i]]);
+  (*sc.out)[c] = sum.average();
+}
+
+int raftOverview(const TileRaft& raft, const uint32_t colors[256], int maxSize,
+                 int& width, int& height, vector<uint32_t>& out)
+{
+  /* Every chunk's color, blank to start with. Paging in a raft just to look
+   * at it from far out would page in a whole map as it is panned over. */
+  vector<uint32_t> chunkColors(raft.chunks.size(), colors[0]);
+  if (raft.source)
+  {
+    SourceColors sc = { colors, &chunkColors };
+    /* A corrupt raft pages in blank, so it is shown that way */
+    if (!raft.source->readChunks(raft.sourceIndex, sourceChunkColor, &sc))
+      chunkColors.assign(raft.chunks.size(), colors[0]);
+  }
+  else
+    for (size_t c=0; c<raft.chunks.size(); c++)
+      chunkColors[c] = chunkColor(raft.chunks[c], colors);
+
+  int step = 1;
+  while ((raft.chunksW + step - 1) / step > maxSize || (raft.chunksH + step - 1) / step > maxSize)
+    step *= 2;
+  width = (raft.chunksW + step - 1) / step;
+  height = (raft.chunksH + step - 1) / step;
+
+  out.resize(width * height);
+  for (int y=0; y<height; y++)
+  for (int x=0; x<width; x++)
+  {
+    ColorSum sum;
+    for (int cy=y*step; cy<(y+1)*step && cy<raft.chunksH; cy++)
+    for (int cx=x*step; cx<(x+1)*step && cx<raft.chunksW; cx++)
+      sum.add(chunkColors[cx + cy * raft.chunksW]);
+    out[x + y * width] = sum.average();
+  }
+  return step;
+}
+
+OverviewCache::OverviewCache() :
+  budget(OVERVIEW_DEFAULT_BUDGET),
+  hits(0),
+  uploads(0),
+  evictions(0)
+{
+}
+
+GLuint OverviewCache::lookup(TileChunk *chunk, const uint32_t colors[256], float& u, float& v)
+{
+  unsigned long long id = chunkId(chunk);
+  unsigned int revision = chunkRevision(chunk);
+
+  map<unsigned long long, Entry>::iterator e = entries.find(id);
+  if (e == entries.end())
+  {
+    if (freeSlots.empty())
+    {
+      if (bytes() + OVERVIEW_PAGE_BYTES <= budget)
+      {
+        /* Open a new page */
+        GLuint page;
+        glGenTextures(1, &page);
+        glBindTexture(GL_TEXTURE_2D, page);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, OVERVIEW_PAGE, OVERVIEW_PAGE, 0,
+            GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        for (int i=SLOTS*SLOTS-1; i>=0; i--)
+          freeSlots.push_back(pages.size() * SLOTS * SLOTS + i);
+        pages.push_back(page);
+      }
+      else if (!lru.empty())
+      {
+        /* Take the least recently drawn chunk's slot */
+        map<unsigned long long, Entry>::iterator old = entries.find(lru.back());
+        freeSlots.push_back(old->second.slot);
+        entries.erase(old);
+        lru.pop_back();
+        evictions++;
+      }
+      else
+        return 0;
+    }
+
+    lru.push_front(id);
+    Entry& n = entries[id];
+    n.slot = freeSlots.back();
+    /* Never a chunk revision, so that the overview is uploaded below */
+    n.revision = ~0u;
+    n.use = lru.begin();
+    freeSlots.pop_back();
+    e = entries.find(id);
+  }
+  else
+    lru.splice(lru.begin(), lru, e->second.use);
+
+  int slot = e->second.slot;
+  GLuint page = pages[slot / (SLOTS * SLOTS)];
+  int sx = slot % SLOTS * CHUNKSIZE;
+  int sy = slot / SLOTS % SLOTS * CHUNKSIZE;
+
+  if (e->second.revision != revision)
+  {
+    uint32_t texels[CHUNKSIZE*CHUNKSIZE];
+    chunkOverview(chunk, colors, texels);
+    glBindTexture(GL_TEXTURE_2D, page);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, sx, sy, CHUNKSIZE, CHUNKSIZE,
+        GL_RGBA, GL_UNSIGNED_BYTE, texels);
+    e->second.revision = revision;
+    uploads++;
+  }
+  else
+    hits++;
+
+  u = (float)sx / OVERVIEW_PAGE;
+  v = (float)sy / OVERVIEW_PAGE;
+  return page;
+}
+
+void OverviewCache::clear()
+{
+  if (!pages.empty())
+    glDeleteTextures(pages.size(), &pages[0]);
+  pages.clear();
+  freeSlots.clear();
+  entries.clear();
+  lru.clear();
+}
+
+void OverviewCache::setBudget(size_t budget_)
+{
+  /* Pages are shared by many chunks, so shrinking starts over */
+  budget = budget_;
+  if (bytes() > budget)
+    clear();
+}
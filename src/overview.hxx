@@ -0,0 +1,97 @@
+#ifndef OVERVIEW_HXX
+#define OVERVIEW_HXX
+#ifdef __MACH__
+#  include <OpenGL/gl.h>
+#else
+#  include <GL/gl.h>
+#endif
+#include "tile-raft.hxx"
+#include <stdint.h>
+#include <stddef.h>
+#include <list>
+#include <map>
+#include <vector>
+
+/* Level of detail
+ *
+ * Zoomed far enough out, tiles shrink to a few pixels or less and drawing
+ * them one at a time is mostly wasted. Rafts are drawn from overviews
+ * instead: an image of each chunk with a texel per tile, in that tile's
+ * average color, or further out, an image of each raft with a texel per
+ * chunk. World :: draw() picks the level from the zoom, so that about the
+ * same number of quads is drawn however far out the camera is.
+ */
+#define LOD_TILES 0
+#define LOD_CHUNKS 1
+#define LOD_RAFTS 2
+
+/* The smallest zooms at which rafts are drawn tile by tile (4 pixels to a
+ * tile) and chunk by chunk (8 pixels to a chunk) */
+#define LOD_TILES_MINZOOM (4.0 / TILESIZE)
+#define LOD_CHUNKS_MINZOOM (8.0 / (TILESIZE * CHUNKSIZE))
+
+int lodForZoom(double zoom);
+
+/* Average color of each tile of an RGBA tile set atlas, atlasWidth texels
+ * wide, laid out as DefaultTileset */
+void tileColors(const uint32_t *atlas, int atlasWidth, int atlasHeight, uint32_t colors[256]);
+
+/* Overview of a chunk, CHUNKSIZE*CHUNKSIZE texels, one per tile. A NULL
+ * chunk is blank. */
+void chunkOverview(const TileChunk *chunk, const uint32_t colors[256], uint32_t *out);
+
+/* Average color of a chunk, kept in the chunk until it changes */
+uint32_t chunkColor(TileChunk *chunk, const uint32_t colors[256]);
+
+/* Overview of a raft, with a texel for every step*step chunks, step being
+ * the smallest power of two that keeps it within maxSize texels a side.
+ * Sets width and height to its size and returns step. A raft that hasn't
+ * been paged in is read straight out of its map file, and left unpaged. */
+int raftOverview(const TileRaft& raft, const uint32_t colors[256], int maxSize,
+                 int& width, int& height, std::vector<uint32_t>& out);
+
+/* Chunk overviews in GL textures, many to a texture of OVERVIEW_PAGE texels
+ * a side, uploaded when first drawn and whenever the chunk changes. Slots
+ * are recycled from the least recently drawn chunks once the cache reaches
+ * its budget. */
+#define OVERVIEW_PAGE 1024
+#define OVERVIEW_PAGE_BYTES (OVERVIEW_PAGE * OVERVIEW_PAGE * 4)
+#define OVERVIEW_DEFAULT_BUDGET (32 << 20)
+
+struct OverviewCache {
+  size_t budget;
+
+  /* Overviews drawn, and uploaded */
+  unsigned long hits;
+  unsigned long uploads;
+  unsigned long evictions;
+
+  OverviewCache();
+
+  /* Texture holding chunk's overview, uploading it there first if need
+   * be, with (u, v) set to the overview's top left corner; or 0 if the
+   * budget doesn't allow a single page. A NULL chunk is blank. Leaves
+   * either that texture or whatever was already bound bound. */
+  GLuint lookup(TileChunk *chunk, const uint32_t colors[256], float& u, float& v);
+
+  /* Delete every texture; the GL context must still be current */
+  void clear();
+  void setBudget(size_t budget);
+
+  size_t bytes() const { return pages.size() * OVERVIEW_PAGE_BYTES; }
+
+private:
+  struct Entry {
+    int slot;
+    unsigned int revision;
+    /* Position in lru */
+    std::list<unsigned long long>::iterator use;
+  };
+
+  std::vector<GLuint> pages;
+  std::vector<int> freeSlots;
+  std::map<unsigned long long, Entry> entries;
+  /* Most recently used first */
+  std::list<unsigned long long> lru;
+};
+#endif
@@ -0,0 +1,335 @@
+#include "pathfind.hxx"
+#include "tile-raft.hxx"
+#include "job-pool.hxx"
+#include <limits.h>
+#include <stdlib.h>
+#include <algorithm>
+
+using namespace std;
+
+/* A chunk's row of tiles is built as one piece of a word */
+#if CHUNKSIZE > 32 || 64 % CHUNKSIZE
+#  error NavGrid :: update() needs CHUNKSIZE to divide 64
+#endif
+
+/* Costs are kept in thousandths of a tile, as integers, so that however a
+ * path is added up, by the step or by the run, it comes to the same */
+#define COST_STRAIGHT 1000
+#define COST_DIAGONAL 1414
+
+NavTiles navTiles;
+
+NavTiles::NavTiles() :
+  revision(0)
+{
+  for (int i=0; i<256; i++)
+    walkable[i] = i != 0;
+}
+
+void NavTiles::set(unsigned char tile, bool walkable_)
+{
+  walkable[tile] = walkable_;
+  revision++;
+}
+
+void NavGrid::update(const TileRaft& raft, const NavTiles& tiles)
+{
+  chunksBuilt = 0;
+  if (width != raft.width || height != raft.height || tilesRevision != tiles.revision)
+  {
+    width = raft.width;
+    height = raft.height;
+    words = (width + 63) / 64;
+    bits.assign(words * height, 0);
+    /* No chunk has id ~0, so every one is built below */
+    chunkIds.assign(raft.chunksW * raft.chunksH, ~0ULL);
+    chunkRevisions.assign(raft.chunksW * raft.chunksH, 0);
+    tilesRevision = tiles.revision;
+  }
+
+  for (int cy=0; cy<raft.chunksH; cy++)
+  for (int cx=0; cx<raft.chunksW; cx++)
+  {
+    TileChunk *c = raft.chunk(cx, cy);
+    unsigned long long id = chunkId(c);
+    unsigned int revision = chunkRevision(c);
+    int i = cx + cy * raft.chunksW;
+    if (chunkIds[i] == id && chunkRevisions[i] == revision)
+      continue;
+    chunkIds[i] = id;
+    chunkRevisions[i] = revision;
+    chunksBuilt++;
+
+    int x0 = cx * CHUNKSIZE, y0 = cy * CHUNKSIZE;
+    int w = min(CHUNKSIZE, width - x0), h = min(CHUNKSIZE, height - y0);
+    int shift = x0 & 63;
+    uint64_t keep = ~((((uint64_t)1 << CHUNKSIZE) - 1) << shift);
+    uint64_t blank = tiles.walkable[0] ? ((uint64_t)1 << w) - 1 : 0;
+    for (int ty=0; ty<h; ty++)
+    {
+      uint64_t row = blank;
+      if (c)
+      {
+        const unsigned char *t = c->tiles + ty * CHUNKSIZE;
+        row = 0;
+        for (int tx=0; tx<w; tx++)
+          row |= (uint64_t)tiles.walkable[t[tx]] << tx;
+      }
+      uint64_t& word = bits[(x0 >> 6) + (y0 + ty) * words];
+      word = (word & keep) | row << shift;
+    }
+  }
+}
+
+void NavSearch::reset()
+{
+  if (nodes.empty())
+  {
+    Node empty = { -1, -1, 0, false };
+    nodes.assign(1024, empty);
+  }
+  for (size_t i=0; i<used.size(); i++)
+    nodes[used[i]].cell = -1;
+  used.clear();
+  open.clear();
+}
+
+NavSearch::Node& NavSearch::node(int cell)
+{
+  if (used.size() * 2 >= nodes.size())
+  {
+    /* Grow, and put the nodes back */
+    vector<Node> old;
+    old.swap(nodes);
+    Node empty = { -1, -1, 0, false };
+    nodes.assign(old.size() * 2, empty);
+    used.clear();
+    for (size_t i=0; i<old.size(); i++)
+      if (old[i].cell >= 0)
+        node(old[i].cell) = old[i];
+  }
+
+  size_t mask = nodes.size() - 1;
+  size_t i = (unsigned int)cell * 2654435761u & mask;
+  while (nodes[i].cell != cell)
+  {
+    if (nodes[i].cell < 0)
+    {
+      Node fresh = { cell, -1, INT_MAX, false };
+      nodes[i] = fresh;
+      used.push_back(i);
+      break;
+    }
+    i = (i + 1) & mask;
+  }
+  return nodes[i];
+}
+
+/* Cost of a straight or diagonal run, or as a heuristic, of the cheapest
+ * path there could be */
+static inline int octile(int dx, int dy)
+{
+  dx = abs(dx);
+  dy = abs(dy);
+  return dx < dy ? dx * COST_DIAGONAL + (dy - dx) * COST_STRAIGHT
+                 : dy * COST_DIAGONAL + (dx - dy) * COST_STRAIGHT;
+}
+
+static inline int sign(int v)
+{
+  return (v > 0) - (v < 0);
+}
+
+/* Step from (x, y) in direction (dx, dy), having come from (x-dx, y-dy),
+ * until reaching the goal or a tile with a forced neighbour, which is then
+ * the jump point (jx, jy). Returns false if the way is blocked first. */
+static bool jump(const NavGrid& g, int x, int y, int dx, int dy, int gx, int gy, int& jx, int& jy)
+{
+  for (;;)
+  {
+    if (!g.walkable(x, y))
+      return false;
+    if (x == gx && y == gy)
+      break;
+
+    if (dx && dy)
+    {
+      /* A diagonal run stops where a straight run off it would */
+      int sx, sy;
+      if (jump(g, x + dx, y, dx, 0, gx, gy, sx, sy) || jump(g, x, y + dy, 0, dy, gx, gy, sx, sy))
+        break;
+      if (!g.walkable(x + dx, y) || !g.walkable(x, y + dy))
+        return false;
+    }
+    else if (dx)
+    {
+      if ((g.walkable(x, y - 1) && !g.walkable(x - dx, y - 1))
+      ||  (g.walkable(x, y + 1) && !g.walkable(x - dx, y + 1)))
+        break;
+    }
+    else
+    {
+      if ((g.walkable(x - 1, y) && !g.walkable(x - 1, y - dy))
+      ||  (g.walkable(x + 1, y) && !g.walkable(x + 1, y - dy)))
+        break;
+    }
+    x += dx;
+    y += dy;
+  }
+  jx = x;
+  jy = y;
+  return true;
+}
+
+/* Directions worth searching from (x, y), as (dx, dy) pairs in dirs, having
+ * arrived from (px, py), or from nowhere if px is -1. Diagonals are only
+ * taken if both tiles beside them are walkable. */
+static int successors(const NavGrid& g, int x, int y, int px, int py, bool prune, int dirs[16])
+{
+  int n = 0;
+#define ADD(DX, DY) do { dirs[n++] = (DX); dirs[n++] = (DY); } while (0)
+  if (px < 0 || !prune)
+  {
+    for (int dy=-1; dy<=1; dy++)
+    for (int dx=-1; dx<=1; dx++)
+      if ((dx || dy) && g.walkable(x + dx, y + dy)
+      &&  (!dx || !dy || (g.walkable(x + dx, y) && g.walkable(x, y + dy))))
+        ADD(dx, dy);
+    return n / 2;
+  }
+
+  int dx = sign(x - px), dy = sign(y - py);
+  if (dx && dy)
+  {
+    bool h = g.walkable(x + dx, y), v = g.walkable(x, y + dy);
+    if (v) ADD(0, dy);
+    if (h) ADD(dx, 0);
+    if (h && v) ADD(dx, dy);
+  }
+  else if (dx)
+  {
+    bool up = g.walkable(x, y - 1), down = g.walkable(x, y + 1);
+    if (g.walkable(x + dx, y))
+    {
+      ADD(dx, 0);
+      if (up) ADD(dx, -1);
+      if (down) ADD(dx, 1);
+    }
+    if (up) ADD(0, -1);
+    if (down) ADD(0, 1);
+  }
+  else
+  {
+    bool left = g.walkable(x - 1, y), right = g.walkable(x + 1, y);
+    if (g.walkable(x, y + dy))
+    {
+      ADD(0, dy);
+      if (left) ADD(-1, dy);
+      if (right) ADD(1, dy);
+    }
+    if (left) ADD(-1, 0);
+    if (right) ADD(1, 0);
+  }
+#undef ADD
+  return n / 2;
+}
+
+bool navFindPath(const NavGrid& grid, int x0, int y0, int x1, int y1,
+                 NavPath& path, NavSearch& s, bool jumping)
+{
+  path.points.clear();
+  path.cost = 0;
+  path.expanded = 0;
+  if (!grid.walkable(x0, y0) || !grid.walkable(x1, y1)
+  ||  (long long)grid.width * grid.height > INT_MAX)
+    return false;
+
+  s.reset();
+  int w = grid.width;
+  int start = x0 + y0 * w, goal = x1 + y1 * w;
+  s.node(start).g = 0;
+  NavSearch::Open o = { octile(x1 - x0, y1 - y0), start };
+  s.open.push_back(o);
+
+  bool found = false;
+  while (!s.open.empty())
+  {
+    pop_heap(s.open.begin(), s.open.end());
+    int cell = s.open.back().cell;
+    s.open.pop_back();
+
+    /* Cells may be on the open list more than once; only the first, and
+     * cheapest, counts */
+    NavSearch::Node& cur = s.node(cell);
+    if (cur.closed)
+      continue;
+    cur.closed = true;
+    path.expanded++;
+    if (cell == goal)
+    {
+      found = true;
+      break;
+    }
+
+    int g = cur.g;
+    int x = cell % w, y = cell / w;
+    int px = -1, py = -1;
+    if (cur.parent >= 0)
+    {
+      px = cur.parent % w;
+      py = cur.parent / w;
+    }
+
+    int dirs[16];
+    int n = successors(grid, x, y, px, py, jumping, dirs);
+    for (int d=0; d<n; d++)
+    {
+      int tx = x + dirs[2*d], ty = y + dirs[2*d+1];
+      if (jumping && !jump(grid, tx, ty, dirs[2*d], dirs[2*d+1], x1, y1, tx, ty))
+        continue;
+
+      int tg = g + octile(tx - x, ty - y);
+      NavSearch::Node& t = s.node(tx + ty * w);
+      if (t.closed || tg >= t.g)
+        continue;
+      t.g = tg;
+      t.parent = cell;
+      NavSearch::Open next = { tg + octile(x1 - tx, y1 - ty), tx + ty * w };
+      s.open.push_back(next);
+      push_heap(s.open.begin(), s.open.end());
+    }
+  }
+  if (!found)
+    return false;
+
+  for (int cell = goal; cell >= 0; cell = s.node(cell).parent)
+  {
+    path.points.push_back(cell / w);
+    path.points.push_back(cell % w);
+  }
+  reverse(path.points.begin(), path.points.end());
+  path.cost = s.node(goal).g / (float)COST_STRAIGHT;
+  return true;
+}
+
+struct PathJob {
+  vector<PathQuery> *queries;
+  bool jump;
+};
+
+static void findPaths(void *data, int begin, int end)
+{
+  PathJob& job = *(PathJob*)data;
+  NavSearch search;
+  for (int i=begin; i<end; i++)
+  {
+    PathQuery& q = (*job.queries)[i];
+    q.found = navFindPath(*q.grid, q.x0, q.y0, q.x1, q.y1, q.path, search, job.jump);
+  }
+}
+
+void navFindPaths(vector<PathQuery>& queries, bool jump)
+{
+  PathJob job = { &queries, jump };
+  parallelFor(queries.size(), 4, findPaths, &job);
+}
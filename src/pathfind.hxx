@@ -0,0 +1,123 @@
+#ifndef PATHFIND_HXX
+#define PATHFIND_HXX
+#include <stdint.h>
+#include <vector>
+
+struct TileRaft;
+
+/* Pathfinding over the tiles of a raft
+ *
+ * Agents move between the 8 neighbouring tiles, at a cost of 1 straight
+ * and sqrt(2) diagonally, and may only cut a corner if both tiles beside
+ * the diagonal are walkable. Which tiles are walkable is set by NavTiles.
+ *
+ * Searches don't read rafts directly. Each raft has a NavGrid, a bit per
+ * tile, that is brought up to date before searching. Like SolidMask, it
+ * remembers which revision of each chunk it was built from, but it only
+ * rebuilds the chunks that have changed, so an edit costs a chunk's worth of
+ * work however large the raft is.
+ *
+ * navFindPath() does jump point search (Harabor and Grastien, 2011): along
+ * straight and diagonal runs without forced neighbours, nothing is pushed
+ * on the open list, so open areas cost next to nothing. Plain A* gives the
+ * same costs and is kept for comparison.
+ */
+
+/* Walkability of each tile value. The game has one tile set, and so one
+ * table, navTiles. */
+struct NavTiles {
+  bool walkable[256];
+  /* Incremented by set(), so that every NavGrid is rebuilt */
+  unsigned int revision;
+
+  /* Every tile but the blank tile 0 is walkable */
+  NavTiles();
+
+  void set(unsigned char tile, bool walkable);
+};
+
+extern NavTiles navTiles;
+
+/* One bit per tile, set for walkable tiles, 64 tiles to a word */
+struct NavGrid {
+  int width;
+  int height;
+  int words;
+  std::vector<uint64_t> bits;
+
+  /* The id and revision of each chunk as its bits were last built, and the
+   * NavTiles revision they were built with */
+  std::vector<unsigned long long> chunkIds;
+  std::vector<unsigned int> chunkRevisions;
+  unsigned int tilesRevision;
+
+  /* Chunks built by the last update() */
+  int chunksBuilt;
+
+  NavGrid() : width(0), height(0), words(0), tilesRevision(0), chunksBuilt(0) {}
+
+  /* Rebuild the bits of any chunks of raft that have changed. Must be
+   * called on the main thread, as it may page the raft in. */
+  void update(const TileRaft& raft, const NavTiles& tiles = navTiles);
+
+  bool walkable(int x, int y) const
+  {
+    if ((unsigned)x >= (unsigned)width || (unsigned)y >= (unsigned)height)
+      return false;
+    return bits[(x >> 6) + y * words] >> (x & 63) & 1;
+  }
+};
+
+struct NavPath {
+  /* Waypoints as x, y pairs, from start to goal; the path runs in a straight
+   * or diagonal line from each to the next */
+  std::vector<int> points;
+  float cost;
+  /* Nodes taken off the open list */
+  int expanded;
+};
+
+/* Working storage for searches, which keeping between searches saves
+ * reallocating. One can't be shared by searches running at once. */
+struct NavSearch {
+  struct Node {
+    int cell;
+    int parent;
+    /* Cost from the start, in thousandths of a tile */
+    int g;
+    bool closed;
+  };
+  struct Open {
+    int f;
+    int cell;
+    /* Cheapest first, from the STL's heap functions */
+    bool operator<(const Open& o) const { return f > o.f; }
+  };
+
+  /* Open addressed, by cell; cell is -1 in empty slots */
+  std::vector<Node> nodes;
+  std::vector<int> used;
+  std::vector<Open> open;
+
+  void reset();
+  /* The node for cell, added with g infinite if new */
+  Node& node(int cell);
+};
+
+/* Find the cheapest path on grid from (x0, y0) to (x1, y1), by jump point
+ * search, or if jump is false, plain A*. Returns false if there is none. */
+bool navFindPath(const NavGrid& grid, int x0, int y0, int x1, int y1,
+                 NavPath& path, NavSearch& search, bool jump = true);
+
+struct PathQuery {
+  const NavGrid *grid;
+  int x0, y0, x1, y1;
+
+  bool found;
+  NavPath path;
+};
+
+/* Run every query, spread over the job pool. The grids must be up to date,
+ * and aren't changed. */
+void navFindPaths(std::vector<PathQuery>& queries, bool jump = true);
+#endif
@@ -0,0 +1,122 @@
+#include "console.hxx"
+#include "profiler.hxx"
+#include <SDL.h>
+#include <SDL_thread.h>
+#include <stdio.h>
+#include <algorithm>
+#include <vector>
+using namespace std;
+
+bool perfEnabled = false;
+
+static const char *phaseNames[PERF_NPHASES] = {
+  "events",
+  "Game::Step",
+  "Game::Draw",
+  "World::draw",
+  "OGLCONSOLE_Draw",
+  "SDL_GL_SwapBuffers",
+  "glError",
+};
+
+struct PerfSample {
+  double start;
+  double duration;
+  Uint32 thread;
+};
+
+struct PerfRing {
+  PerfSample samples[PERF_SAMPLES];
+  /* Total number of samples ever claimed; the slot is head % PERF_SAMPLES */
+  volatile unsigned int head;
+};
+
+static PerfRing rings[PERF_NPHASES];
+
+void perfRecord(int phase, double start, double end)
+{
+  PerfRing& ring = rings[phase];
+  unsigned int i = __sync_fetch_and_add(&ring.head, 1) % PERF_SAMPLES;
+  ring.samples[i].start = start;
+  ring.samples[i].duration = end - start;
+  ring.samples[i].thread = SDL_ThreadID();
+}
+
+void perfReset()
+{
+  for (int p=0; p<PERF_NPHASES; p++)
+    rings[p].head = 0;
+}
+
+/* Copy out the samples currently held by a ring, oldest first */
+static void snapshot(int phase, vector<PerfSample>& out)
+{
+  PerfRing& ring = rings[phase];
+  __sync_synchronize();
+  unsigned int head = ring.head;
+  unsigned int n = min(head, (unsigned int)PERF_SAMPLES);
+  out.resize(n);
+  for (unsigned int i=0; i<n; i++)
+    out[i] = ring.samples[(head - n + i) % PERF_SAMPLES];
+}
+
+static double percentile(const vector<double>& sorted, double p)
+{
+  size_t i = (size_t)(p * (sorted.size() - 1) + 0.5);
+  return sorted[i];
+}
+
+void perfReport()
+{
+  vector<PerfSample> samples;
+  vector<double> ms;
+
+  conPrint("%-20s %7s %8s %8s %8s\n", "phase", "samples", "p50 ms", "p95 ms", "p99 ms");
+  for (int p=0; p<PERF_NPHASES; p++)
+  {
+    snapshot(p, samples);
+    if (samples.empty())
+      continue;
+    ms.resize(samples.size());
+    for (size_t i=0; i<samples.size(); i++)
+      ms[i] = samples[i].duration * 1000;
+    sort(ms.begin(), ms.end());
+    conPrint("%-20s %7u %8.3f %8.3f %8.3f\n", phaseNames[p], (unsigned int)ms.size(),
+        percentile(ms, 0.50), percentile(ms, 0.95), percentile(ms, 0.99));
+  }
+}
+
+bool perfDumpTrace(string filename)
+{
+  FILE *f = fopen(filename.c_str(), "w");
+  if (!f)
+  {
+    conPrint("could not open \"%s\"\n", filename.c_str());
+    return false;
+  }
+
+  vector<PerfSample> samples;
+  bool first = true;
+  fprintf(f, "{\"traceEvents\":[\n");
+  for (int p=0; p<PERF_NPHASES; p++)
+  {
+    snapshot(p, samples);
+    for (size_t i=0; i<samples.size(); i++)
+    {
+      fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+          first ? "" : ",\n", phaseNames[p], (unsigned int)samples[i].thread,
+          samples[i].start * 1e6, samples[i].duration * 1e6);
+      first = false;
+    }
+  }
+  fprintf(f, "\n]}\n");
+
+  bool ok = !ferror(f);
+  if (fclose(f) != 0)
+    ok = false;
+  if (!ok)
+    conPrint("error writing \"%s\"\n", filename.c_str());
+  else
+    conPrint("wrote trace \"%s\"\n", filename.c_str());
+  return ok;
+}
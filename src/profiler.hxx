@@ -0,0 +1,78 @@
+#ifndef PROFILER_HXX
+#define PROFILER_HXX
+#include "timer.hxx"
+#include <string>
+
+/* Per-phase frame profiler
+ *
+ * Wrap a hot section in PERF_SCOPE(phase) and, while profiling is enabled,
+ * its start time and duration are recorded into that phase's ring buffer.
+ * When it is disabled, a scope costs one load and branch. For sections that
+ * aren't a block of their own, PERF_BEGIN(var, phase) and PERF_END(var) time
+ * from one statement to another. Building with
+ * -DNO_PROFILER removes the scopes altogether.
+ *
+ * Each ring buffer keeps the last PERF_SAMPLES samples. Writers claim slots
+ * with an atomic increment, so scopes may be used from any thread without
+ * locking.
+ */
+#define PERF_SAMPLES 4096
+
+enum PerfPhase {
+  PERF_EVENTS,
+  PERF_STEP,
+  PERF_GAME_DRAW,
+  PERF_WORLD_DRAW,
+  PERF_CONSOLE_DRAW,
+  PERF_SWAP,
+  PERF_GLERROR,
+  PERF_NPHASES
+};
+
+extern bool perfEnabled;
+
+void perfRecord(int phase, double start, double end);
+
+/* Print p50/p95/p99 of every phase to the console */
+void perfReport();
+
+/* Write every sample as a Chrome trace (chrome://tracing) JSON file */
+bool perfDumpTrace(std::string filename);
+
+void perfReset();
+
+struct PerfScope {
+  int phase;
+  double start;
+
+  PerfScope(int phase_) :
+    phase(phase_),
+    start(perfEnabled ? timerSeconds() : -1)
+  {
+  }
+
+  ~PerfScope()
+  {
+    end();
+  }
+
+  void end()
+  {
+    if (start >= 0)
+      perfRecord(phase, start, timerSeconds());
+    start = -1;
+  }
+};
+
+#ifdef NO_PROFILER
+#  define PERF_SCOPE(phase) do{}while(0)
+#  define PERF_BEGIN(var, phase) do{}while(0)
+#  define PERF_END(var) do{}while(0)
+#else
+#  define PERF_SCOPE_NAME2(line) perfScope_##line
+#  define PERF_SCOPE_NAME(line) PERF_SCOPE_NAME2(line)
+#  define PERF_SCOPE(phase) PerfScope PERF_SCOPE_NAME(__LINE__)(phase)
+#  define PERF_BEGIN(var, phase) PerfScope var(phase)
+#  define PERF_END(var) var.end()
+#endif
+#endif
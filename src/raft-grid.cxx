@@ -0,0 +1,157 @@
+#include "raft-grid.hxx"
+#include <algorithm>
+using namespace std;
+
+/* Division rounding towards negative infinity */
+static inline int cellOf(int a)
+{
+  return a >= 0 ? a / RAFTGRID_CELLSIZE : -((-a + RAFTGRID_CELLSIZE - 1) / RAFTGRID_CELLSIZE);
+}
+
+RaftGrid::RaftGrid() :
+  stamp(0)
+{
+}
+
+void RaftGrid::clear()
+{
+  boxes.clear();
+  present.clear();
+  big.clear();
+  bigRafts.clear();
+  cells.clear();
+  seen.clear();
+}
+
+/* Cells covered by b, inclusive. Returns false for an empty box. */
+bool RaftGrid::cellRange(const Box& b, int& cx0, int& cy0, int& cx1, int& cy1) const
+{
+  if (b.x0 >= b.x1 || b.y0 >= b.y1)
+    return false;
+  cx0 = cellOf(b.x0);
+  cy0 = cellOf(b.y0);
+  cx1 = cellOf(b.x1 - 1);
+  cy1 = cellOf(b.y1 - 1);
+  return true;
+}
+
+void RaftGrid::remove(int i)
+{
+  if (!present[i])
+    return;
+  present[i] = false;
+
+  if (big[i])
+  {
+    bigRafts.erase(find(bigRafts.begin(), bigRafts.end(), i));
+    return;
+  }
+
+  int cx0, cy0, cx1, cy1;
+  if (!cellRange(boxes[i], cx0, cy0, cx1, cy1))
+    return;
+  for (int cy=cy0; cy<=cy1; cy++)
+  for (int cx=cx0; cx<=cx1; cx++)
+  {
+    map<long long, vector<int> >::iterator cell = cells.find(key(cx, cy));
+    cell->second.erase(find(cell->second.begin(), cell->second.end(), i));
+    if (cell->second.empty())
+      cells.erase(cell);
+  }
+}
+
+void RaftGrid::set(int i, int x0, int y0, int x1, int y1)
+{
+  if (i >= (int)boxes.size())
+  {
+    boxes.resize(i + 1);
+    present.resize(i + 1, false);
+    big.resize(i + 1, false);
+    seen.resize(i + 1, 0);
+  }
+  remove(i);
+
+  Box& b = boxes[i];
+  b.x0 = x0;
+  b.y0 = y0;
+  b.x1 = x1;
+  b.y1 = y1;
+  present[i] = true;
+
+  int cx0, cy0, cx1, cy1;
+  if (!cellRange(b, cx0, cy0, cx1, cy1))
+  {
+    /* Nothing to find */
+    big[i] = false;
+    return;
+  }
+
+  big[i] = (long long)(cx1 - cx0 + 1) * (cy1 - cy0 + 1) > RAFTGRID_MAXCELLS;
+  if (big[i])
+  {
+    bigRafts.push_back(i);
+    return;
+  }
+
+  for (int cy=cy0; cy<=cy1; cy++)
+  for (int cx=cx0; cx<=cx1; cx++)
+    cells[key(cx, cy)].push_back(i);
+}
+
+/* Append the rafts in list that overlap the rectangle and haven't been seen
+ * yet in this query */
+void RaftGrid::collect(const vector<int>& list, int x0, int y0, int x1, int y1, vector<int>& out)
+{
+  for (vector<int>::const_iterator i = list.begin(); i != list.end(); ++i)
+  {
+    if (seen[*i] == stamp)
+      continue;
+    seen[*i] = stamp;
+    const Box& b = boxes[*i];
+    if (b.x0 < x1 && x0 < b.x1 && b.y0 < y1 && y0 < b.y1)
+      out.push_back(*i);
+  }
+}
+
+void RaftGrid::queryPoint(int x, int y, vector<int>& out)
+{
+  queryRect(x, y, x + 1, y + 1, out);
+}
+
+void RaftGrid::queryRect(int x0, int y0, int x1, int y1, vector<int>& out)
+{
+  out.clear();
+  if (x0 >= x1 || y0 >= y1)
+    return;
+
+  /* Start a new generation of stamps, resetting them all on wrap-around */
+  if (++stamp == 0)
+  {
+    fill(seen.begin(), seen.end(), 0);
+    stamp = 1;
+  }
+
+  collect(bigRafts, x0, y0, x1, y1, out);
+
+  int cx0 = cellOf(x0), cy0 = cellOf(y0);
+  int cx1 = cellOf(x1 - 1), cy1 = cellOf(y1 - 1);
+  if ((long long)(cx1 - cx0 + 1) * (cy1 - cy0 + 1) > (long long)cells.size())
+  {
+    /* The rectangle covers more cells than are occupied; visit those instead */
+    for (map<long long, vector<int> >::iterator cell = cells.begin(); cell != cells.end(); ++cell)
+      collect(cell->second, x0, y0, x1, y1, out);
+  }
+  else
+  {
+    for (int cy=cy0; cy<=cy1; cy++)
+    for (int cx=cx0; cx<=cx1; cx++)
+    {
+      map<long long, vector<int> >::iterator cell = cells.find(key(cx, cy));
+      if (cell == cells.end())
+        continue;
+      collect(cell->second, x0, y0, x1, y1, out);
+    }
+  }
+
+  sort(out.begin(), out.end());
+}
@@ -0,0 +1,54 @@
+#ifndef RAFT_GRID_HXX
+#define RAFT_GRID_HXX
+#include <map>
+#include <vector>
+
+/* A uniform grid over the bounding boxes of a World's rafts, for finding the
+ * rafts at a point or overlapping a rectangle without visiting them all.
+ * Rafts are identified by their index in World :: rafts. Boxes are in world
+ * pixels, half-open: [x0,x1) x [y0,y1).
+ *
+ * Rafts spanning more than RAFTGRID_MAXCELLS cells aren't entered into the
+ * grid at all; they're kept on a separate list that every query checks, so
+ * that one huge raft doesn't fill thousands of cells. */
+#define RAFTGRID_CELLSIZE 512
+#define RAFTGRID_MAXCELLS 256
+
+struct RaftGrid {
+  struct Box {
+    int x0, y0, x1, y1;
+  };
+
+  RaftGrid();
+
+  void clear();
+
+  /* Add raft i, or move it if it's already in the grid */
+  void set(int i, int x0, int y0, int x1, int y1);
+
+  /* Indices of the rafts containing the point, in ascending order */
+  void queryPoint(int x, int y, std::vector<int>& out);
+
+  /* Indices of the rafts overlapping the rectangle, in ascending order */
+  void queryRect(int x0, int y0, int x1, int y1, std::vector<int>& out);
+
+private:
+  std::vector<Box> boxes;
+  std::vector<bool> present;
+  std::vector<bool> big;
+  std::vector<int> bigRafts;
+  std::map<long long, std::vector<int> > cells;
+
+  /* Stamps for removing duplicates from query results */
+  std::vector<unsigned int> seen;
+  unsigned int stamp;
+
+  void remove(int i);
+  void collect(const std::vector<int>& list, int x0, int y0, int x1, int y1, std::vector<int>& out);
+  bool cellRange(const Box& b, int& cx0, int& cy0, int& cx1, int& cy1) const;
+  static long long key(int cx, int cy)
+  {
+    return (long long)((unsigned long long)(unsigned int)cy << 32 | (unsigned int)cx);
+  }
+};
+#endif
@@ -0,0 +1,252 @@
+#include "region.hxx"
+#include "tile-raft.hxx"
+#include "rle.hxx"
+#include <string.h>
+#include <algorithm>
+#if defined(__AVX2__)
+#  include <immintrin.h>
+#elif defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
+
+using namespace std;
+
+void regionBlend(unsigned char *dst, const unsigned char *src, size_t n)
+{
+#if defined(__AVX2__)
+  __m256i zero = _mm256_setzero_si256();
+  for (; n >= 32; n -= 32, dst += 32, src += 32)
+  {
+    __m256i s = _mm256_loadu_si256((const __m256i*)src);
+    __m256i d = _mm256_loadu_si256((const __m256i*)dst);
+    __m256i clear = _mm256_cmpeq_epi8(s, zero);
+    _mm256_storeu_si256((__m256i*)dst, _mm256_blendv_epi8(s, d, clear));
+  }
+#elif defined(__SSE2__)
+  __m128i zero = _mm_setzero_si128();
+  for (; n >= 16; n -= 16, dst += 16, src += 16)
+  {
+    __m128i s = _mm_loadu_si128((const __m128i*)src);
+    __m128i d = _mm_loadu_si128((const __m128i*)dst);
+    __m128i clear = _mm_cmpeq_epi8(s, zero);
+    _mm_storeu_si128((__m128i*)dst, _mm_or_si128(s, _mm_and_si128(clear, d)));
+  }
+#endif
+  for (; n; n--, dst++, src++)
+    if (*src)
+      *dst = *src;
+}
+
+/* Clip [x0,x1) x [y0,y1) to raft, returning false if nothing is left */
+static bool clip(const TileRaft& raft, int& x0, int& y0, int& x1, int& y1)
+{
+  x0 = max(x0, 0);
+  y0 = max(y0, 0);
+  x1 = min(x1, raft.width);
+  y1 = min(y1, raft.height);
+  return x0 < x1 && y0 < y1;
+}
+
+static bool allZero(const unsigned char *p, int n)
+{
+  for (int i=0; i<n; i++)
+    if (p[i])
+      return false;
+  return true;
+}
+
+/* Write n tiles of row y from column x, which must lie within raft */
+static void writeRow(TileRaft& raft, int x, int y, int n, const unsigned char *in, bool masked)
+{
+  if (!masked)
+  {
+    raft.setRow(x, y, n, in);
+    return;
+  }
+
+  while (n > 0)
+  {
+    int k = min(n, CHUNKSIZE - x % CHUNKSIZE);
+    if (!allZero(in, k))
+      regionBlend(raft.touchChunk(x / CHUNKSIZE, y / CHUNKSIZE)->tiles
+                  + x%CHUNKSIZE + y%CHUNKSIZE*CHUNKSIZE, in, k);
+    x += k;
+    in += k;
+    n -= k;
+  }
+}
+
+void regionFill(TileRaft& raft, int x0, int y0, int x1, int y1, unsigned char tile)
+{
+  if (!clip(raft, x0, y0, x1, y1))
+    return;
+
+  for (int cy = y0 / CHUNKSIZE; cy <= (y1 - 1) / CHUNKSIZE; cy++)
+  for (int cx = x0 / CHUNKSIZE; cx <= (x1 - 1) / CHUNKSIZE; cx++)
+  {
+    if (tile == 0 && !raft.chunk(cx, cy))
+      continue;
+
+    int tx0 = max(x0 - cx * CHUNKSIZE, 0);
+    int ty0 = max(y0 - cy * CHUNKSIZE, 0);
+    int tx1 = min(x1 - cx * CHUNKSIZE, CHUNKSIZE);
+    int ty1 = min(y1 - cy * CHUNKSIZE, CHUNKSIZE);
+    unsigned char *tiles = raft.touchChunk(cx, cy)->tiles;
+
+    if (tx0 == 0 && tx1 == CHUNKSIZE)
+      /* Whole rows of the chunk are contiguous */
+      rleFill(tiles + ty0 * CHUNKSIZE, tile, (ty1 - ty0) * CHUNKSIZE);
+    else
+      for (int ty = ty0; ty < ty1; ty++)
+        rleFill(tiles + tx0 + ty * CHUNKSIZE, tile, tx1 - tx0);
+  }
+}
+
+void regionCopy(const TileRaft& src, int x0, int y0, int x1, int y1, TileRegion& out)
+{
+  out.width = max(x1 - x0, 0);
+  out.height = max(y1 - y0, 0);
+  out.tiles.assign(out.width * out.height, 0);
+
+  int cx0 = x0, cy0 = y0, cx1 = x1, cy1 = y1;
+  if (!clip(src, cx0, cy0, cx1, cy1))
+    return;
+  for (int y = cy0; y < cy1; y++)
+    src.getRow(cx0, y, cx1 - cx0, &out.tiles[(cx0 - x0) + (y - y0) * out.width]);
+}
+
+void regionPaste(TileRaft& raft, const TileRegion& region, int x, int y, bool masked)
+{
+  int x0 = x, y0 = y, x1 = x + region.width, y1 = y + region.height;
+  if (!clip(raft, x0, y0, x1, y1))
+    return;
+  for (int ty = y0; ty < y1; ty++)
+    writeRow(raft, x0, ty, x1 - x0, &region.tiles[(x0 - x) + (ty - y) * region.width], masked);
+}
+
+void regionBlit(TileRaft& dst, int x, int y, const TileRaft& src,
+                int x0, int y0, int x1, int y1, bool masked)
+{
+  /* Clip to the source, then the destination, moving the other rectangle
+   * along with each */
+  int sx0 = x0, sy0 = y0;
+  if (!clip(src, x0, y0, x1, y1))
+    return;
+  x += x0 - sx0;
+  y += y0 - sy0;
+
+  int dx0 = x, dy0 = y, dx1 = x + (x1 - x0), dy1 = y + (y1 - y0);
+  if (!clip(dst, dx0, dy0, dx1, dy1))
+    return;
+  x0 += dx0 - x;
+  y0 += dy0 - y;
+
+  int w = dx1 - dx0;
+  int h = dy1 - dy0;
+  vector<unsigned char> row(w);
+
+  /* Each row is staged through a buffer, so overlap within a row is fine;
+   * walking rows bottom-up when moving down takes care of the rest */
+  bool bottomUp = &src == &dst && dy0 > y0;
+  for (int i = 0; i < h; i++)
+  {
+    int r = bottomUp ? h - 1 - i : i;
+    src.getRow(x0, y0 + r, w, &row[0]);
+    writeRow(dst, dx0, dy0 + r, w, &row[0], masked);
+  }
+}
+
+/* Fill the span of target tiles on row y around x, returning it in
+ * [x0,x1) */
+static void fillSpan(TileRaft& raft, int x, int y, unsigned char target,
+                     unsigned char tile, int& x0, int& x1)
+{
+  x0 = x;
+  while (x0 > 0 && raft.get(x0 - 1, y) == target)
+    x0--;
+  x1 = x + 1;
+  while (x1 < raft.width && raft.get(x1, y) == target)
+    x1++;
+  regionFill(raft, x0, y, x1, y + 1, tile);
+}
+
+/* Note a span filled by regionBucketFill() in the stack's changed list and
+ * bounding box */
+static void noteSpan(BucketStack& stack, const BucketStack::Span& s)
+{
+  stack.changed.push_back(s);
+  stack.x0 = min(stack.x0, s.x0);
+  stack.x1 = max(stack.x1, s.x1);
+  stack.y0 = min(stack.y0, s.y);
+  stack.y1 = max(stack.y1, s.y + 1);
+}
+
+size_t regionBucketFill(TileRaft& raft, int x, int y, unsigned char tile,
+                        bool diagonal, BucketStack& stack)
+{
+  stack.spans.clear();
+  stack.changed.clear();
+  stack.maxDepth = 0;
+  stack.x0 = stack.y0 = stack.x1 = stack.y1 = 0;
+  if (x < 0 || y < 0 || x >= raft.width || y >= raft.height)
+    return 0;
+  unsigned char target = raft.get(x, y);
+  if (target == tile)
+    return 0;
+
+  size_t filled = 0;
+  int reach = diagonal ? 1 : 0;
+  BucketStack::Span s;
+  fillSpan(raft, x, y, target, tile, s.x0, s.x1);
+  s.y = y;
+  filled += s.x1 - s.x0;
+  stack.x0 = s.x0;
+  stack.x1 = s.x1;
+  stack.y0 = y;
+  stack.y1 = y + 1;
+  stack.changed.push_back(s);
+  s.dy = 1;
+  stack.spans.push_back(s);
+  s.dy = -1;
+  stack.spans.push_back(s);
+
+  while (!stack.spans.empty())
+  {
+    stack.maxDepth = max(stack.maxDepth, stack.spans.size());
+    BucketStack::Span parent = stack.spans.back();
+    stack.spans.pop_back();
+
+    int ny = parent.y + parent.dy;
+    if (ny < 0 || ny >= raft.height)
+      continue;
+
+    /* Every run of target tiles on row ny touching the parent span starts
+     * a new span. Spans already filled no longer match target, so nothing
+     * is visited twice. */
+    int end = min(parent.x1 + reach, raft.width);
+    for (int nx = max(parent.x0 - reach, 0); nx < end; nx++)
+    {
+      if (raft.get(nx, ny) != target)
+        continue;
+
+      BucketStack::Span child;
+      fillSpan(raft, nx, ny, target, tile, child.x0, child.x1);
+      child.y = ny;
+      filled += child.x1 - child.x0;
+      noteSpan(stack, child);
+
+      /* Carry on away from the parent, and turn back towards it only if the
+       * child reaches past the parent's span and the tiles bounding it, the
+       * only part of the parent's row known not to need filling */
+      child.dy = parent.dy;
+      stack.spans.push_back(child);
+      if (child.x0 < parent.x0 - 1 + reach || child.x1 > parent.x1 + 1 - reach)
+      {
+        child.dy = -parent.dy;
+        stack.spans.push_back(child);
+      }
+      nx = child.x1;
+    }
+  }
+  return filled;
+}
@@ -0,0 +1,69 @@
+#ifndef REGION_HXX
+#define REGION_HXX
+#include <stddef.h>
+#include <vector>
+
+struct TileRaft;
+
+/* Rectangular operations on rafts
+ *
+ * Rectangles are half-open, [x0,x1) x [y0,y1), in tiles, and are clipped to
+ * the rafts involved, so they may hang off a raft's edges or miss it
+ * entirely. Everything works a chunk row at a time with memset/memcpy or
+ * SIMD kernels, and a fill of tile 0 over a chunk that was never allocated
+ * leaves it unallocated.
+ */
+
+/* A block of tiles lifted out of a raft */
+struct TileRegion {
+  int width;
+  int height;
+  std::vector<unsigned char> tiles;
+
+  TileRegion() : width(0), height(0) {}
+};
+
+void regionFill(TileRaft& raft, int x0, int y0, int x1, int y1, unsigned char tile);
+
+/* Copy a rectangle of src into out. Tiles outside src read as 0. */
+void regionCopy(const TileRaft& src, int x0, int y0, int x1, int y1, TileRegion& out);
+
+/* Write region into raft with its top-left corner at (x, y). If masked,
+ * tile 0 in region is transparent and leaves raft's tile as it was. */
+void regionPaste(TileRaft& raft, const TileRegion& region, int x, int y, bool masked=false);
+
+/* Copy a rectangle of src to (x, y) in dst. src and dst may be the same raft,
+ * and the rectangles may overlap. */
+void regionBlit(TileRaft& dst, int x, int y, const TileRaft& src,
+                int x0, int y0, int x1, int y1, bool masked=false);
+
+/* Working storage for regionBucketFill(). Keeping one around between fills
+ * saves regrowing the stack each time. */
+struct BucketStack {
+  struct Span {
+    int x0, x1;  /* [x0,x1) was filled on row y... */
+    int y;
+    int dy;      /* ...having been reached from row y-dy */
+  };
+  std::vector<Span> spans;
+  /* The most spans that were pending at once during the last fill */
+  size_t maxDepth;
+  /* The spans the last fill changed, and their bounding box, [x0,x1) x
+   * [y0,y1), which is empty if nothing changed. Enough to journal just the
+   * tiles a fill touched. */
+  std::vector<Span> changed;
+  int x0, y0, x1, y1;
+
+  BucketStack() : maxDepth(0), x0(0), y0(0), x1(0), y1(0) { spans.reserve(4096); }
+};
+
+/* Replace tile (x, y) and every tile with the same value 4-connected (or
+ * 8-connected, if diagonal) to it with tile. Returns the number of tiles
+ * changed, and leaves where they were in stack. Scanline fill with an
+ * explicit stack, so it doesn't recurse. */
+size_t regionBucketFill(TileRaft& raft, int x, int y, unsigned char tile,
+                        bool diagonal, BucketStack& stack);
+
+/* dst[i] = src[i] ? src[i] : dst[i] */
+void regionBlend(unsigned char *dst, const unsigned char *src, size_t n);
+#endif
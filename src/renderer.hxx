@@ -0,0 +1,42 @@
+#ifndef RENDERER_HXX
+#define RENDERER_HXX
+
+struct TileChunk;
+struct TileRaft;
+
+/* Everything the game draws goes through a Renderer, so that the same world
+ * can be drawn by the GL (GLRenderer) or into memory with no GL context at all
+ * (SoftRenderer). Coordinates are view pixels, with (0,0) top left of the
+ * screen; each covers zoom screen pixels, zoom being set for the frame by
+ * beginFrame(). */
+struct Renderer {
+  virtual ~Renderer() {}
+
+  virtual void beginFrame(int width, int height, float zoom) = 0;
+  virtual void endFrame() = 0;
+
+  /* Draw the tiles in columns [x0,x1) and rows [y0,y1) of a chunk, relative
+   * to the chunk, whose top left corner is at (x, y). A NULL chunk is blank. */
+  virtual void drawChunk(TileChunk *chunk, float x, float y, int x0, int y0, int x1, int y1) = 0;
+
+  /* Called with the chunks a frame is about to draw, before any of them is
+   * drawn, so that per-chunk work can be done for all of them at once */
+  virtual void prepareChunks(TileChunk *const *chunks, int n) {}
+
+  /* Draw the top left w*h tiles of a chunk, top left corner at (x, y), from
+   * its overview: a texel per tile, in the tile's average color. For when
+   * tiles are too small on screen to be worth drawing one by one (see
+   * overview.hxx). A NULL chunk is blank. */
+  virtual void drawChunkOverview(TileChunk *chunk, float x, float y, int w, int h) = 0;
+
+  /* Draw a whole raft, top left corner at (x, y), from its overview: a
+   * texel per chunk, in the chunk's average color */
+  virtual void drawRaftOverview(TileRaft *raft, float x, float y) = 0;
+
+  /* Draw a single tile, e.g. for sprites or the edit cursor */
+  virtual void drawTile(float x, float y, unsigned char tile) = 0;
+};
+
+/* The renderer Game :: Draw() uses */
+extern Renderer *renderer;
+#endif
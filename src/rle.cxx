@@ -0,0 +1,210 @@
+#include "rle.hxx"
+#include <string.h>
+#if defined(__AVX2__)
+#  include <immintrin.h>
+#elif defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
+
+void rleFill(unsigned char *dst, unsigned char tile, size_t n)
+{
+#if defined(__AVX2__)
+  __m256i v = _mm256_set1_epi8(tile);
+  for (; n >= 32; n -= 32, dst += 32)
+    _mm256_storeu_si256((__m256i*)dst, v);
+#elif defined(__SSE2__)
+  __m128i v = _mm_set1_epi8(tile);
+  for (; n >= 64; n -= 64, dst += 64)
+  {
+    _mm_storeu_si128((__m128i*)dst +0, v);
+    _mm_storeu_si128((__m128i*)dst +1, v);
+    _mm_storeu_si128((__m128i*)dst +2, v);
+    _mm_storeu_si128((__m128i*)dst +3, v);
+  }
+  for (; n >= 16; n -= 16, dst += 16)
+    _mm_storeu_si128((__m128i*)dst, v);
+#endif
+  memset(dst, tile, n);
+}
+
+RleEncoder::RleEncoder(std::vector<unsigned char>& out_) :
+  out(out_),
+  literalLength(0),
+  runTile(0),
+  runLength(0)
+{
+}
+
+void RleEncoder::flushLiteral()
+{
+  if (!literalLength)
+    return;
+  out.push_back(literalLength - 1);
+  out.insert(out.end(), literal, literal + literalLength);
+  literalLength = 0;
+}
+
+void RleEncoder::flushRun()
+{
+  if (runLength >= RLE_MINRUN)
+  {
+    flushLiteral();
+    size_t n = runLength - RLE_MINRUN;
+    if (n < 0x7f)
+      out.push_back(0x80 | n);
+    else
+    {
+      out.push_back(0xff);
+      n -= 0x7f;
+      do
+      {
+        out.push_back((n & 0x7f) | (n >= 0x80 ? 0x80 : 0));
+        n >>= 7;
+      } while (n);
+    }
+    out.push_back(runTile);
+  }
+  else
+  {
+    /* Too short to be worth a run packet */
+    for (size_t i=0; i<runLength; i++)
+    {
+      literal[literalLength++] = runTile;
+      if (literalLength == sizeof(literal))
+        flushLiteral();
+    }
+  }
+  runLength = 0;
+}
+
+void RleEncoder::put(const unsigned char *data, size_t n)
+{
+  const unsigned char *end = data + n;
+  while (data < end)
+  {
+    if (runLength && *data == runTile)
+    {
+      /* Extend the current run as far as it goes */
+      const unsigned char *p = data;
+      while (p < end && *p == runTile) p++;
+      runLength += p - data;
+      data = p;
+    }
+    else
+    {
+      flushRun();
+      runTile = *data++;
+      runLength = 1;
+    }
+  }
+}
+
+void RleEncoder::putRun(unsigned char tile, size_t n)
+{
+  if (!n)
+    return;
+  if (!runLength || tile != runTile)
+  {
+    flushRun();
+    runTile = tile;
+  }
+  runLength += n;
+}
+
+void RleEncoder::finish()
+{
+  flushRun();
+  flushLiteral();
+}
+
+RleDecoder::RleDecoder(const unsigned char *in_, size_t size) :
+  in(in_),
+  end(in_ + size),
+  runLeft(0),
+  runTile(0),
+  literalLeft(0)
+{
+}
+
+/* Give up on a corrupt packet. Nothing of it is left to decode, so every
+ * later read() fails too, rather than trusting a half-read count. */
+bool RleDecoder::fail()
+{
+  runLeft = 0;
+  literalLeft = 0;
+  in = end;
+  return false;
+}
+
+bool RleDecoder::nextPacket()
+{
+  if (in >= end)
+    return false;
+
+  unsigned char c = *in++;
+  if (c < 0x80)
+  {
+    if ((size_t)(end - in) < (size_t)c + 1)
+      return fail();
+    literalLeft = c + 1;
+    return true;
+  }
+
+  size_t run = (c & 0x7f) + RLE_MINRUN;
+  if ((c & 0x7f) == 0x7f)
+  {
+    size_t extra = 0;
+    int shift = 0;
+    do
+    {
+      if (in >= end || shift > 56)
+        return fail();
+      extra |= (size_t)(*in & 0x7f) << shift;
+      shift += 7;
+    } while (*in++ & 0x80);
+    run += extra;
+  }
+  if (in >= end)
+    return fail();
+  runTile = *in++;
+  runLeft = run;
+  return true;
+}
+
+bool RleDecoder::read(unsigned char *out, size_t n)
+{
+  while (n)
+  {
+    if (!runLeft && !literalLeft && !nextPacket())
+      return false;
+
+    if (runLeft)
+    {
+      size_t k = runLeft < n ? runLeft : n;
+      rleFill(out, runTile, k);
+      runLeft -= k;
+      out += k;
+      n -= k;
+    }
+    else
+    {
+      size_t k = literalLeft < n ? literalLeft : n;
+      memcpy(out, in, k);
+      in += k;
+      literalLeft -= k;
+      out += k;
+      n -= k;
+    }
+  }
+  return true;
+}
+
+bool RleDecoder::skipRun(unsigned char tile, size_t n)
+{
+  if (!runLeft && !literalLeft && in < end && !nextPacket())
+    return false;
+  if (runLeft < n || runTile != tile)
+    return false;
+  runLeft -= n;
+  return true;
+}
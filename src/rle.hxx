@@ -0,0 +1,74 @@
+#ifndef RLE_HXX
+#define RLE_HXX
+#include <stddef.h>
+#include <vector>
+
+/* Run-length encoding of tile data
+ *
+ * The stream is a sequence of packets, each starting with a control byte c:
+ *
+ *   c < 0x80   a literal: the next c+1 bytes are copied as they are
+ *   c >= 0x80  a run: the next byte is repeated (c & 0x7f) + RLE_MINRUN
+ *              times. If (c & 0x7f) is 0x7f, a LEB128 varint follows the
+ *              control byte and is added to the run length.
+ *
+ * Both the encoder and decoder work incrementally, so a raft can be streamed
+ * a chunk at a time without being copied into one contiguous buffer.
+ */
+#define RLE_MINRUN 3
+
+struct RleEncoder {
+  std::vector<unsigned char>& out;
+
+  RleEncoder(std::vector<unsigned char>& out_);
+
+  void put(const unsigned char *data, size_t n);
+
+  /* Same as put()ting n copies of tile */
+  void putRun(unsigned char tile, size_t n);
+
+  /* Flush everything that is still pending to out */
+  void finish();
+
+private:
+  unsigned char literal[128];
+  size_t literalLength;
+  unsigned char runTile;
+  size_t runLength;
+
+  void flushRun();
+  void flushLiteral();
+};
+
+struct RleDecoder {
+  const unsigned char *in;
+  const unsigned char *end;
+
+  RleDecoder(const unsigned char *in_, size_t size);
+
+  /* Decode the next n bytes into out. Returns false if the stream is corrupt
+   * or ends too soon. */
+  bool read(unsigned char *out, size_t n);
+
+  /* If the next n bytes are all tile, skip over them and return true */
+  bool skipRun(unsigned char tile, size_t n);
+
+  /* True once every byte of the stream has been decoded */
+  bool done() const
+  {
+    return in == end && runLeft == 0 && literalLeft == 0;
+  }
+
+private:
+  size_t runLeft;
+  unsigned char runTile;
+  size_t literalLeft;
+
+  bool nextPacket();
+  bool fail();
+};
+
+/* memset() with AVX2 or SSE2 stores, when the build targets them (configure
+ * asks for whichever the build machine runs) */
+void rleFill(unsigned char *dst, unsigned char tile, size_t n);
+#endif
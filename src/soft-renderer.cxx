@@ -0,0 +1,122 @@
+#include "soft-renderer.hxx"
+#include "tile-raft.hxx"
+#include "mapfile.hxx"
+#include "overview.hxx"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+using namespace std;
+
+SoftRenderer::SoftRenderer(const uint32_t *atlas_, int atlasWidth_, int atlasHeight_) :
+  width(0),
+  height(0),
+  atlas(atlas_),
+  atlasWidth(atlasWidth_),
+  atlasHeight(atlasHeight_),
+  zoom(1)
+{
+  tileColors(atlas, atlasWidth, atlasHeight, tileColor);
+}
+
+void SoftRenderer::beginFrame(int width_, int height_, float zoom_)
+{
+  width = width_;
+  height = height_;
+  zoom = zoom_;
+  framebuffer.assign(width * height, 0);
+}
+
+void SoftRenderer::endFrame()
+{
+}
+
+void SoftRenderer::blit(const uint32_t *src, int stride, int w, int h,
+                        float x0, float y0, float x1, float y1, float clipX, float clipY)
+{
+  /* A pixel is covered if its center is, and takes the texel under its
+   * center, as the GL would have it */
+  float sx0 = x0 * zoom, sy0 = y0 * zoom;
+  float sx1 = x1 * zoom, sy1 = y1 * zoom;
+  int px0 = max(0, (int)ceil(sx0 - 0.5f)), py0 = max(0, (int)ceil(sy0 - 0.5f));
+  int px1 = min(width, (int)ceil(min(x1, clipX) * zoom - 0.5f));
+  int py1 = min(height, (int)ceil(min(y1, clipY) * zoom - 0.5f));
+  float du = w / (sx1 - sx0), dv = h / (sy1 - sy0);
+
+  for (int py=py0; py<py1; py++)
+  {
+    int v = min(h - 1, (int)((py + 0.5f - sy0) * dv));
+    const uint32_t *row = src + v * stride;
+    uint32_t *out = &framebuffer[py * width];
+    for (int px=px0; px<px1; px++)
+      out[px] = row[min(w - 1, (int)((px + 0.5f - sx0) * du))];
+  }
+}
+
+void SoftRenderer::drawTile(float x, float y, unsigned char tile)
+{
+  /* Texels per tile, should the atlas not be TILESIZE per tile */
+  int tw = atlasWidth / TILESETW;
+  int th = atlasHeight / TILESETH;
+  if (tw != TILESIZE || th != TILESIZE)
+    return;
+
+  const uint32_t *src = atlas + (tile/TILESETW) * th * atlasWidth + (tile%TILESETW) * tw;
+  if (zoom != 1)
+  {
+    float x1 = x + TILESIZE, y1 = y + TILESIZE;
+    blit(src, atlasWidth, TILESIZE, TILESIZE, x, y, x1, y1, x1, y1);
+    return;
+  }
+
+  /* The GL samples texel centers, so a tile lands on whole pixels */
+  int px = (int)floor(x + 0.5f);
+  int py = (int)floor(y + 0.5f);
+
+  /* Clip against the framebuffer */
+  int sx0 = max(0, -px), sy0 = max(0, -py);
+  int sx1 = min(TILESIZE, width - px), sy1 = min(TILESIZE, height - py);
+  if (sx0 >= sx1 || sy0 >= sy1)
+    return;
+
+  for (int sy=sy0; sy<sy1; sy++)
+    memcpy(&framebuffer[(py + sy) * width + px + sx0],
+           src + sy * atlasWidth + sx0,
+           (sx1 - sx0) * sizeof(uint32_t));
+}
+
+void SoftRenderer::drawChunk(TileChunk *chunk, float x, float y, int x0, int y0, int x1, int y1)
+{
+  for (int ty=y0; ty<y1; ty++)
+  for (int tx=x0; tx<x1; tx++)
+    drawTile(x + tx * TILESIZE, y + ty * TILESIZE, chunk ? chunk->tiles[tx + ty*CHUNKSIZE] : 0);
+}
+
+void SoftRenderer::drawChunkOverview(TileChunk *chunk, float x, float y, int w, int h)
+{
+  uint32_t texels[CHUNKSIZE*CHUNKSIZE];
+  chunkOverview(chunk, tileColor, texels);
+  float x1 = x + w * TILESIZE, y1 = y + h * TILESIZE;
+  blit(texels, CHUNKSIZE, w, h, x, y, x1, y1, x1, y1);
+}
+
+void SoftRenderer::drawRaftOverview(TileRaft *raft, float x, float y)
+{
+  static vector<uint32_t> texels;
+  int w, h;
+  int step = raftOverview(*raft, tileColor, 256, w, h, texels);
+  if (texels.empty())
+    return;
+
+  /* As in GLRenderer, only the part of the edge texels the raft covers */
+  float chunkPixels = CHUNKSIZE * TILESIZE * step;
+  float x1 = x + w * chunkPixels, y1 = y + h * chunkPixels;
+  float cx1 = x + raft->width * TILESIZE, cy1 = y + raft->height * TILESIZE;
+  blit(&texels[0], w, w, h, x, y, x1, y1, cx1, cy1);
+}
+
+uint32_t SoftRenderer::checksum() const
+{
+  if (framebuffer.empty())
+    return mapChecksum(NULL, 0);
+  return mapChecksum((const unsigned char*)&framebuffer[0], framebuffer.size() * sizeof(uint32_t));
+}
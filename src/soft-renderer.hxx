@@ -0,0 +1,47 @@
+#ifndef SOFT_RENDERER_HXX
+#define SOFT_RENDERER_HXX
+#include "renderer.hxx"
+#include <stdint.h>
+#include <vector>
+
+/* Rasterizes tiles into a framebuffer in memory, with no GL context, for
+ * benchmarking and regression-testing rendering on machines without a GPU.
+ * The output matches what GLRenderer draws: tiles are copied texel for texel
+ * from the tile set, with blending disabled, or at other zooms, scaled with
+ * nearest neighbour sampling. */
+struct SoftRenderer : Renderer {
+  int width;
+  int height;
+  /* RGBA, width*height, row-major from the top */
+  std::vector<uint32_t> framebuffer;
+
+  /* The tile set: RGBA, atlasWidth*atlasHeight texels, TILESETW*TILESETH
+   * tiles. It is not copied and must outlive the renderer. */
+  const uint32_t *atlas;
+  int atlasWidth;
+  int atlasHeight;
+
+  float zoom;
+  /* Average color of each tile, for overviews */
+  uint32_t tileColor[256];
+
+  SoftRenderer(const uint32_t *atlas_, int atlasWidth_, int atlasHeight_);
+
+  void beginFrame(int width, int height, float zoom);
+  void endFrame();
+  void drawChunk(TileChunk *chunk, float x, float y, int x0, int y0, int x1, int y1);
+  void drawChunkOverview(TileChunk *chunk, float x, float y, int w, int h);
+  void drawRaftOverview(TileRaft *raft, float x, float y);
+  void drawTile(float x, float y, unsigned char tile);
+
+  /* Checksum of the framebuffer, to compare renders across builds */
+  uint32_t checksum() const;
+
+private:
+  /* Scale the w*h texels at src, rows stride texels apart, onto the view
+   * rectangle from (x0, y0) to (x1, y1), drawing only the part left and
+   * above of (clipX, clipY) */
+  void blit(const uint32_t *src, int stride, int w, int h,
+            float x0, float y0, float x1, float y1, float clipX, float clipY);
+};
+#endif
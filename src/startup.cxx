@@ -0,0 +1,67 @@
+#include "startup.hxx"
+#include "console.hxx"
+#include "timer.hxx"
+#include <stdio.h>
+
+struct StartupPhase {
+  const char *name;
+  double start;
+  double end;
+};
+
+static StartupPhase phases[STARTUP_MAXPHASES];
+static int nphases;
+static double begun;
+static double lastMark;
+
+void startupBegin()
+{
+  begun = lastMark = timerSeconds();
+  nphases = 0;
+}
+
+void startupSpan(const char *name, double start, double end)
+{
+  if (nphases == STARTUP_MAXPHASES)
+    return;
+  /* Keep them in order of starting */
+  int i = nphases++;
+  for (; i > 0 && phases[i-1].start > start; i--)
+    phases[i] = phases[i-1];
+  phases[i].name = name;
+  phases[i].start = start;
+  phases[i].end = end;
+}
+
+void startupMark(const char *name)
+{
+  double t = timerSeconds();
+  startupSpan(name, lastMark, t);
+  lastMark = t;
+}
+
+double startupElapsed()
+{
+  return timerSeconds() - begun;
+}
+
+static void print(bool toConsole, const char *line)
+{
+  if (toConsole)
+    conPrint("%s", line);
+  else
+    fputs(line, stdout);
+}
+
+void startupReport(bool toConsole)
+{
+  print(toConsole, "startup phases (ms):\n");
+  print(toConsole, "   start  length\n");
+  for (int i=0; i<nphases; i++)
+  {
+    char line[128];
+    snprintf(line, sizeof(line), "%8.1f %7.1f  %s\n", (phases[i].start - begun) * 1000,
+        (phases[i].end - phases[i].start) * 1000, phases[i].name);
+    print(toConsole, line);
+  }
+}
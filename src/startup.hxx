@@ -0,0 +1,29 @@
+#ifndef STARTUP_HXX
+#define STARTUP_HXX
+
+/* Startup tracing
+ *
+ * main() marks the end of each phase of startup as it goes, and each phase
+ * is charged with the time since the mark before it. Work done off the main
+ * thread, overlapping those phases, is added with startupSpan() once it is
+ * known how long it took. Everything is timed from startupBegin(), which
+ * main() calls first thing; what the loader and static constructors do
+ * before that isn't counted.
+ *
+ * Only call these from the main thread.
+ */
+#define STARTUP_MAXPHASES 32
+
+void startupBegin();
+/* The phase called name ends now */
+void startupMark(const char *name);
+/* Something that ran from start to end, by timerSeconds(), likely on
+ * another thread */
+void startupSpan(const char *name, double start, double end);
+/* Seconds since startupBegin() */
+double startupElapsed();
+
+/* Print every phase, in the order it started, with its start and length,
+ * to the console or to stdout */
+void startupReport(bool toConsole = true);
+#endif
@@ -0,0 +1,29 @@
+#include "tile-mesh.hxx"
+
+void TileMesh::draw(GLfloat x, GLfloat y) const
+{
+  draw(x, y, 0, 0, width, height);
+}
+
+void TileMesh::draw(GLfloat x, GLfloat y, int x0, int y0, int x1, int y1) const
+{
+  if (x0 >= x1 || y0 >= y1)
+    return;
+
+  glPushMatrix();
+  glTranslatef(x, y, 0);
+
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+  glVertexPointer(2, GL_FLOAT, 0, &vertices[0]);
+  glTexCoordPointer(2, GL_FLOAT, 0, &texCoords[0]);
+  if (x0 == 0 && x1 == width)
+    glDrawArrays(GL_QUADS, y0 * width * 4, (y1 - y0) * width * 4);
+  else
+    for (int y=y0; y<y1; y++)
+      glDrawArrays(GL_QUADS, (y * width + x0) * 4, (x1 - x0) * 4);
+  glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+
+  glPopMatrix();
+}
@@ -0,0 +1,100 @@
+#ifndef TILE_MESH_HXX
+#define TILE_MESH_HXX
+#include "tileset.hxx"
+#include <string.h>
+#include <vector>
+
+/* A TileMesh holds packed float vertex and texture coordinate arrays for a
+ * grid of tiles, so that the whole grid can be handed to the GL with a single
+ * glDrawArrays() call instead of eight immediate-mode calls per tile. Vertices
+ * are relative to the grid's origin; draw() translates them into place. */
+struct TileMesh {
+  int width;
+  int height;
+  std::vector<GLfloat> vertices;
+  std::vector<GLfloat> texCoords;
+
+  TileMesh() : width(0), height(0) {}
+
+  /* (Re)build the arrays from a row-major width*height grid of tiles, laid
+   * out as in tile set Set */
+  template <class Set>
+  void build(const unsigned char *tiles, int width, int height);
+
+  /* The same, for DefaultTileset */
+  void build(const unsigned char *tiles, int width, int height)
+  {
+    build<DefaultTileset>(tiles, width, height);
+  }
+
+  /* Submit the mesh with its origin at (x, y) */
+  void draw(GLfloat x, GLfloat y) const;
+
+  /* Submit only the tiles in columns [x0,x1) and rows [y0,y1). Full-width
+   * ranges are still a single draw call; otherwise there is one per row. */
+  void draw(GLfloat x, GLfloat y, int x0, int y0, int x1, int y1) const;
+};
+
+template <class Set>
+void TileMesh::build(const unsigned char *tiles, int width_, int height_)
+{
+  width = width_;
+  height = height_;
+  vertices.resize(width * height * 8);
+  texCoords.resize(width * height * 8);
+  if (width * height == 0)
+    return;
+
+  GLfloat *v = &vertices[0];
+  GLfloat *t = &texCoords[0];
+
+  for (int y=0; y<height; y++)
+  {
+    /* Position of the row's polygons, relative to the mesh origin */
+    GLfloat vy0 = y * Set::size;
+    GLfloat vy1 = vy0 + Set::size;
+    GLfloat vx0 = 0;
+    for (int x=0; x<width; x++)
+    {
+      GLfloat vx1 = vx0 + Set::size;
+
+      /* Same winding as drawTile() */
+      v[0] = vx0; v[1] = vy0;
+      v[2] = vx1; v[3] = vy0;
+      v[4] = vx1; v[5] = vy1;
+      v[6] = vx0; v[7] = vy1;
+      memcpy(t, Set::uv(*tiles++).quad, sizeof(TileUV));
+      v += 8;
+      t += 8;
+      vx0 = vx1;
+    }
+  }
+}
+
+/* This function can draw a tile from the tile set for map tiles or sprites */
+template <class Set>
+inline void drawTile(GLfloat vx0, GLfloat vy0, unsigned char tile)
+{
+  /* Determine full boundaries of the tile or sprite's polygon */
+  GLfloat vx1 = vx0 + Set::size;
+  GLfloat vy1 = vy0 + Set::size;
+
+  /* Position of the tile or sprite in the texture containing our tile set */
+  const GLfloat *uv = Set::uv(tile).quad;
+
+  /* Send vertices to the GL */
+  glTexCoord2fv(uv + 0);
+  glVertex2f   (vx0, vy0);
+  glTexCoord2fv(uv + 2);
+  glVertex2f   (vx1, vy0);
+  glTexCoord2fv(uv + 4);
+  glVertex2f   (vx1, vy1);
+  glTexCoord2fv(uv + 6);
+  glVertex2f   (vx0, vy1);
+}
+
+inline void drawTile(GLfloat vx0, GLfloat vy0, unsigned char tile)
+{
+  drawTile<DefaultTileset>(vx0, vy0, tile);
+}
+#endif
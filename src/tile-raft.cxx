@@ -0,0 +1,271 @@
+#include "log.hxx"
+#include "tile-raft.hxx"
+#include "mapfile.hxx"
+#include "arena.hxx"
+#include <string.h>
+#include <algorithm>
+#include <new>
+using namespace std;
+
+unsigned long tileHeapAllocations = 0;
+
+static unsigned long long nextChunkId = 1;
+static unsigned long long nextRaftRevision = 1;
+
+TileChunk::TileChunk() :
+  tiles(new unsigned char[CHUNKSIZE*CHUNKSIZE]),
+  shared(false),
+  pooled(false),
+  dirty(false),
+  revision(1),
+  id(nextChunkId++),
+  meshRevision(0),
+  color(0),
+  colorRevision(0)
+{
+  memset(tiles, 0, CHUNKSIZE*CHUNKSIZE);
+}
+
+TileChunk::TileChunk(unsigned char *sharedTiles) :
+  tiles(sharedTiles),
+  shared(true),
+  pooled(false),
+  dirty(false),
+  revision(1),
+  id(nextChunkId++),
+  meshRevision(0),
+  color(0),
+  colorRevision(0)
+{
+}
+
+TileChunk::~TileChunk()
+{
+  if (!shared && !pooled)
+    delete[] tiles;
+}
+
+TileRaft::TileRaft(int width_, int height_, Arena *arena_) :
+  width(width_),
+  height(height_),
+  xOff(0),
+  yOff(0),
+  source(NULL),
+  sourceIndex(-1),
+  arena(arena_)
+{
+  allocChunks();
+}
+
+TileRaft::TileRaft(MapFile *source_, int sourceIndex_, int width_, int height_, Arena *arena_) :
+  width(width_),
+  height(height_),
+  xOff(0),
+  yOff(0),
+  source(source_),
+  sourceIndex(sourceIndex_),
+  arena(arena_)
+{
+  allocChunks();
+}
+
+void TileRaft::page() const
+{
+  if (!source)
+    return;
+
+  /* Paging in doesn't change the raft's contents, only where they live */
+  TileRaft *self = const_cast<TileRaft*>(this);
+  MapFile *file = source;
+  self->source = NULL;
+  file->page(*self, sourceIndex);
+}
+
+TileRaft::~TileRaft()
+{
+  for (vector<TileChunk*>::iterator c = chunks.begin(); c != chunks.end(); ++c)
+    freeChunk(*c);
+}
+
+TileChunk *TileRaft::newChunk(unsigned char *sharedTiles)
+{
+  if (!arena)
+  {
+    tileHeapAllocations += sharedTiles ? 1 : 2;
+    return sharedTiles ? new TileChunk(sharedTiles) : new TileChunk;
+  }
+
+  if (sharedTiles)
+    return new (arena->alloc(sizeof(TileChunk))) TileChunk(sharedTiles);
+
+  unsigned char *tiles = (unsigned char*) arena->alloc(CHUNKSIZE*CHUNKSIZE);
+  memset(tiles, 0, CHUNKSIZE*CHUNKSIZE);
+  TileChunk *c = new (arena->alloc(sizeof(TileChunk))) TileChunk(tiles);
+  c->shared = false;
+  c->pooled = true;
+  return c;
+}
+
+void TileRaft::freeChunk(TileChunk *c)
+{
+  if (!c)
+    return;
+  if (arena)
+    c->~TileChunk();
+  else
+    delete c;
+}
+
+void TileRaft::allocChunks()
+{
+  revision = nextRaftRevision++;
+  chunksW = (width  + CHUNKSIZE - 1) / CHUNKSIZE;
+  chunksH = (height + CHUNKSIZE - 1) / CHUNKSIZE;
+  chunks.assign(chunksW * chunksH, (TileChunk*)NULL);
+}
+
+TileChunk *TileRaft::touchChunk(int cx, int cy)
+{
+  page();
+  TileChunk *&c = chunks[cx + cy*chunksW];
+  if (!c)
+    c = newChunk();
+  else if (c->shared)
+  {
+    /* Copy on write */
+    unsigned char *tiles;
+    if (arena)
+      tiles = (unsigned char*) arena->alloc(CHUNKSIZE*CHUNKSIZE);
+    else
+    {
+      tiles = new unsigned char[CHUNKSIZE*CHUNKSIZE];
+      tileHeapAllocations++;
+    }
+    memcpy(tiles, c->tiles, CHUNKSIZE*CHUNKSIZE);
+    c->tiles = tiles;
+    c->shared = false;
+    c->pooled = arena != NULL;
+  }
+  c->dirty = true;
+  c->revision++;
+  revision = nextRaftRevision++;
+  return c;
+}
+
+void TileRaft::set(int x, int y, unsigned char tile)
+{
+  /* Writing the blank tile to a chunk that doesn't exist changes nothing */
+  if (tile == 0 && !chunk(x / CHUNKSIZE, y / CHUNKSIZE))
+    return;
+  touchChunk(x / CHUNKSIZE, y / CHUNKSIZE)->tiles[x%CHUNKSIZE + y%CHUNKSIZE*CHUNKSIZE] = tile;
+}
+
+void TileRaft::getRow(int x, int y, int n, unsigned char *out) const
+{
+  while (n > 0)
+  {
+    int k = min(n, CHUNKSIZE - x % CHUNKSIZE);
+    TileChunk *c = chunk(x / CHUNKSIZE, y / CHUNKSIZE);
+    if (c)
+      memcpy(out, c->tiles + x%CHUNKSIZE + y%CHUNKSIZE*CHUNKSIZE, k);
+    else
+      memset(out, 0, k);
+    x += k;
+    out += k;
+    n -= k;
+  }
+}
+
+void TileRaft::setRow(int x, int y, int n, const unsigned char *in)
+{
+  while (n > 0)
+  {
+    int k = min(n, CHUNKSIZE - x % CHUNKSIZE);
+    int i = 0;
+    /* Blank spans needn't allocate a chunk that doesn't exist yet */
+    if (!chunk(x / CHUNKSIZE, y / CHUNKSIZE))
+      while (i < k && in[i] == 0) i++;
+    if (i < k)
+      memcpy(touchChunk(x / CHUNKSIZE, y / CHUNKSIZE)->tiles + x%CHUNKSIZE + y%CHUNKSIZE*CHUNKSIZE, in, k);
+    x += k;
+    in += k;
+    n -= k;
+  }
+}
+
+void TileRaft::clearDirty()
+{
+  for (vector<TileChunk*>::iterator c = chunks.begin(); c != chunks.end(); ++c)
+    if (*c)
+      (*c)->dirty = false;
+}
+
+void TileRaft::draw(Renderer *r, float xOff, float yOff, int x0, int y0, int x1, int y1)
+{
+  if (x0 >= x1 || y0 >= y1)
+    return;
+
+  for (int cy = y0 / CHUNKSIZE; cy <= (y1 - 1) / CHUNKSIZE; cy++)
+  for (int cx = x0 / CHUNKSIZE; cx <= (x1 - 1) / CHUNKSIZE; cx++)
+  {
+    /* Visible tile range, relative to this chunk */
+    int cx0 = cx * CHUNKSIZE;
+    int cy0 = cy * CHUNKSIZE;
+    r->drawChunk(chunk(cx, cy), xOff + cx0 * TILESIZE, yOff + cy0 * TILESIZE,
+                 max(x0, cx0) - cx0, max(y0, cy0) - cy0,
+                 min(x1, cx0 + CHUNKSIZE) - cx0, min(y1, cy0 + CHUNKSIZE) - cy0);
+  }
+}
+
+ostream& operator<<(ostream& out, const TileRaft& raft)
+{
+  out << "raft"
+      << raft.width << ' '
+      << raft.height << ' ';
+  for (int y=0; y<raft.height; y++)
+  for (int x=0; x<raft.width; x++)
+    out << raft.get(x, y);
+
+  return out;
+}
+
+TileRaft::TileRaft(istream& in, Arena *arena_) :
+  arena(arena_)
+{
+  char magic[5];
+  in.read(magic, 4);
+  magic[4] = '\0';
+  LOGD(LOG_MAP, "TileRaft::TileRaft(istream) magic: %s\n", magic);
+  in >> width
+     >> height;
+  LOGD(LOG_MAP, "TileRaft::TileRaft(istream) dimensions: %dx%d\n", width, height);
+  source = NULL;
+  sourceIndex = -1;
+  allocChunks();
+  char sp;
+  in.read(&sp, 1); // eat extra space
+
+  /* Read a row at a time, and only allocate chunks for non-blank spans */
+  vector<unsigned char> row(width);
+  for (int y=0; y<height && width; y++)
+  {
+    in.read((char*)&row[0], width);
+    for (int cx=0; cx<chunksW; cx++)
+    {
+      int x0 = cx * CHUNKSIZE;
+      int n = min(width - x0, CHUNKSIZE);
+      TileChunk *c = chunk(cx, y / CHUNKSIZE);
+      if (!c)
+      {
+        int i = 0;
+        while (i < n && row[x0 + i] == 0) i++;
+        if (i == n)
+          continue;
+        c = chunks[cx + y / CHUNKSIZE * chunksW] = newChunk();
+      }
+      memcpy(c->tiles + y%CHUNKSIZE*CHUNKSIZE, &row[x0], n);
+    }
+  }
+  xOff = 0;
+  yOff = 0;
+}
@@ -0,0 +1,163 @@
+#ifndef TILE_RAFT_HXX
+#define TILE_RAFT_HXX
+#include "tile-mesh.hxx"
+#include "renderer.hxx"
+#include <stdint.h>
+#include <iostream>
+#include <vector>
+
+/* Rafts are stored as square chunks of CHUNKSIZE*CHUNKSIZE tiles */
+#define CHUNKSIZE 32
+
+struct MapFile;
+struct Arena;
+
+/* Number of chunks and tile blocks allocated on the heap, as opposed to in
+ * an arena, for benchmarks */
+extern unsigned long tileHeapAllocations;
+
+struct TileChunk {
+  /* Row-major, CHUNKSIZE tiles per row, even for chunks on a raft's edge */
+  unsigned char *tiles;
+
+  /* If set, tiles points into memory that this chunk doesn't own, such as a
+   * mapped map file, and must be copied before it is written to */
+  bool shared;
+
+  /* If set, tiles belongs to the raft's arena and isn't freed with the
+   * chunk */
+  bool pooled;
+
+  /* Set by every edit to this chunk. Savers clear it once they have written
+   * the chunk out. */
+  bool dirty;
+
+  /* Incremented by every edit to this chunk. Caches remember the revision
+   * they were built from and rebuild when it changes. */
+  unsigned int revision;
+
+  /* Unique to this chunk for the life of the program, unlike its address,
+   * for caches that may outlive it (see ChunkCache). Never 0. */
+  unsigned long long id;
+
+  /* Vertex arrays for GLRenderer, built from meshRevision */
+  TileMesh mesh;
+  unsigned int meshRevision;
+
+  /* Average color of the tiles as of colorRevision, for level of detail
+   * drawing (see chunkColor()) */
+  uint32_t color;
+  unsigned int colorRevision;
+
+  /* A chunk of blank tiles */
+  TileChunk();
+
+  /* A chunk reading its tiles in place from sharedTiles */
+  TileChunk(unsigned char *sharedTiles);
+
+  ~TileChunk();
+
+private:
+  TileChunk(const TileChunk &);
+  TileChunk & operator=(const TileChunk &);
+};
+
+/* The id and revision caches know a chunk by. Every blank chunk looks the
+ * same, so a NULL chunk has id 0, which no real chunk has, and revision 0. */
+inline unsigned long long chunkId(const TileChunk *c)
+{
+  return c ? c->id : 0;
+}
+
+inline unsigned int chunkRevision(const TileChunk *c)
+{
+  return c ? c->revision : 0;
+}
+
+struct TileRaft {
+  int width;
+  int height;
+  int xOff;
+  int yOff;
+
+  /* Size of the raft in chunks */
+  int chunksW;
+  int chunksH;
+
+  /* chunksW*chunksH chunks, row-major. Chunks are only allocated once a
+   * non-zero tile is written to them; a NULL chunk is all tile 0. */
+  std::vector<TileChunk*> chunks;
+
+  /* Rafts from a binary map file aren't read until their chunks are first
+   * needed. Until then, source is the file and sourceIndex the raft's entry
+   * in it; see MapFile :: page(). */
+  MapFile *source;
+  int sourceIndex;
+
+  /* Where the raft's chunks and their tiles are allocated, or NULL for the
+   * heap. A raft in an arena must be destroyed before the arena is reset. */
+  Arena *arena;
+
+  /* Taken from a program-wide count when the raft is made and whenever one
+   * of its chunks is allocated or edited, so that no two rafts, nor two
+   * states of one raft, share a revision. Caches of things built from the
+   * whole raft compare it. Paging in doesn't change it. */
+  unsigned long long revision;
+
+  TileRaft(int width_, int height_, Arena *arena_=NULL);
+  TileRaft(std::istream& in, Arena *arena_=NULL);
+  TileRaft(MapFile *source_, int sourceIndex_, int width_, int height_, Arena *arena_=NULL);
+  ~TileRaft();
+
+  /* Allocate a blank chunk, or one reading its tiles in place from
+   * sharedTiles, from the raft's arena or the heap. Chunks from here must be
+   * released with freeChunk(). */
+  TileChunk *newChunk(unsigned char *sharedTiles=NULL);
+  void freeChunk(TileChunk *c);
+
+  /* Chunk (cx, cy), or NULL if it has never been written */
+  TileChunk *chunk(int cx, int cy) const
+  {
+    if (source)
+      page();
+    return chunks[cx + cy*chunksW];
+  }
+
+  /* Read the raft's chunks in from its map file if that hasn't happened yet */
+  void page() const;
+
+
+  /* Chunk (cx, cy), allocated if necessary, and marked as modified. Callers
+   * may then write directly to its tiles. */
+  TileChunk *touchChunk(int cx, int cy);
+
+  unsigned char get(int x, int y) const
+  {
+    TileChunk *c = chunk(x / CHUNKSIZE, y / CHUNKSIZE);
+    return c ? c->tiles[x%CHUNKSIZE + y%CHUNKSIZE*CHUNKSIZE] : 0;
+  }
+
+  void set(int x, int y, unsigned char tile);
+
+  /* Copy n tiles of row y, starting at column x, out of or into the raft.
+   * The span must lie within the raft. */
+  void getRow(int x, int y, int n, unsigned char *out) const;
+  void setRow(int x, int y, int n, const unsigned char *in);
+
+  /* Forget that any chunk has been modified; see TileChunk :: dirty */
+  void clearDirty();
+
+  /* Draw the tiles in columns [x0,x1) and rows [y0,y1), with the raft's
+   * top left corner at (xOff, yOff) */
+  void draw(Renderer *r, float xOff, float yOff, int x0, int y0, int x1, int y1);
+
+  friend std::ostream & operator<<(std::ostream &out, const TileRaft &);
+
+private:
+  void allocChunks();
+
+  /* Chunks are owned by their raft */
+  TileRaft(const TileRaft &);
+  TileRaft & operator=(const TileRaft &);
+};
+#endif
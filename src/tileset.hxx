@@ -0,0 +1,68 @@
+#ifndef TILESET_HXX
+#define TILESET_HXX
+#ifdef __MACH__
+#  include <OpenGL/gl.h>
+#else
+#  include <GL/gl.h>
+#endif
+
+/* Geometry of the tile set the game draws with */
+#define TILESIZE 16
+#define TILESETW 32
+#define TILESETH 32
+
+/* Texture coordinates of a tile's corners, as (u, v) pairs in the order
+ * quads are wound: top left, top right, bottom right, bottom left. Copying
+ * them into a texture coordinate array is then a single block move. */
+struct TileUV {
+  GLfloat quad[8];
+};
+
+/* Tile set geometry fixed at compile time: Size pixel square tiles, laid out
+ * Columns across and Rows down the atlas, tile 0 top left. The texture
+ * coordinates of every tile are worked out once, into uv, so code emitting
+ * tiles (see TileMesh :: build()) only does table lookups and multiplies by
+ * constants, with no per-tile division or double math.
+ *
+ * The table is filled in before main() runs, so jobs may read it freely. */
+template <int Size, int Columns, int Rows>
+struct Tileset {
+  enum { size = Size, columns = Columns, rows = Rows };
+
+  struct Table {
+    /* One entry for every value a tile can take */
+    TileUV uv[256];
+
+    Table()
+    {
+      const double tw = 1.0 / Columns, th = 1.0 / Rows;
+      for (int tile=0; tile<256; tile++)
+      {
+        GLfloat u0 = tile % Columns * tw, u1 = (tile % Columns + 1) * tw;
+        GLfloat v0 = tile / Columns * th, v1 = (tile / Columns + 1) * th;
+        GLfloat *q = uv[tile].quad;
+        q[0] = u0; q[1] = v0;
+        q[2] = u1; q[3] = v0;
+        q[4] = u1; q[5] = v1;
+        q[6] = u0; q[7] = v1;
+      }
+    }
+  };
+  static const Table table;
+
+  static const TileUV& uv(unsigned char tile)
+  {
+    return table.uv[tile];
+  }
+};
+
+template <int Size, int Columns, int Rows>
+const typename Tileset<Size, Columns, Rows>::Table Tileset<Size, Columns, Rows>::table;
+
+typedef Tileset<TILESIZE, TILESETW, TILESETH> DefaultTileset;
+
+/* Other tile sizes for the same 512x512 atlas */
+typedef Tileset<8, 64, 64> Tileset8;
+typedef Tileset<16, 32, 32> Tileset16;
+typedef Tileset<32, 16, 16> Tileset32;
+#endif
@@ -0,0 +1,44 @@
+#include "timer.hxx"
+#include <SDL.h>
+#if defined(_WIN32)
+#  include <windows.h>
+#elif defined(__MACH__)
+#  include <mach/mach_time.h>
+#else
+#  include <time.h>
+#endif
+
+double timerSeconds()
+{
+#if defined(_WIN32)
+  static double period = 0;
+  LARGE_INTEGER t;
+  if (!period)
+  {
+    LARGE_INTEGER f;
+    QueryPerformanceFrequency(&f);
+    period = 1.0 / f.QuadPart;
+  }
+  QueryPerformanceCounter(&t);
+  return t.QuadPart * period;
+#elif defined(__MACH__)
+  static double period = 0;
+  if (!period)
+  {
+    mach_timebase_info_data_t info;
+    mach_timebase_info(&info);
+    period = 1e-9 * info.numer / info.denom;
+  }
+  return mach_absolute_time() * period;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+void timerSleep(double seconds)
+{
+  if (seconds > 0)
+    SDL_Delay((Uint32)(seconds * 1000));
+}
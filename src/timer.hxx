@@ -0,0 +1,12 @@
+#ifndef TIMER_HXX
+#define TIMER_HXX
+
+/* Seconds since an arbitrary point, from the best monotonic clock the
+ * platform has. Unlike SDL_GetTicks() it has (much) better than millisecond
+ * resolution. */
+double timerSeconds();
+
+/* Sleep for about the given time. The OS may oversleep by a millisecond or
+ * so, so callers wanting precision should sleep short and re-check. */
+void timerSleep(double seconds);
+#endif
@@ -0,0 +1,250 @@
+#include "undo.hxx"
+#include "tile-raft.hxx"
+#include "rle.hxx"
+
+using namespace std;
+
+/* 4 MiB is a few thousand full-screen fills of mixed content */
+#define UNDO_DEFAULT_BUDGET (4u << 20)
+
+static void encodeRect(const TileRaft& raft, int x0, int y0, int x1, int y1,
+                       vector<unsigned char>& out)
+{
+  vector<unsigned char> row(x1 - x0);
+  RleEncoder rle(out);
+  out.clear();
+  for (int y = y0; y < y1; y++)
+  {
+    raft.getRow(x0, y, x1 - x0, &row[0]);
+    rle.put(&row[0], row.size());
+  }
+  rle.finish();
+}
+
+static void decodeRect(TileRaft& raft, int x0, int y0, int x1, int y1,
+                       const vector<unsigned char>& in)
+{
+  vector<unsigned char> row(x1 - x0);
+  RleDecoder rle(&in[0], in.size());
+  for (int y = y0; y < y1; y++)
+  {
+    if (!rle.read(&row[0], row.size()))
+      return;
+    raft.setRow(x0, y, x1 - x0, &row[0]);
+  }
+}
+
+size_t UndoJournal::Record::size() const
+{
+  return sizeof(*this) + before.capacity() + after.capacity()
+       + positions.capacity() * sizeof(size_t);
+}
+
+UndoJournal::UndoJournal()
+: budget(UNDO_DEFAULT_BUDGET)
+, bytes(0)
+, open(0)
+{
+}
+
+UndoJournal::~UndoJournal()
+{
+  clear();
+}
+
+void UndoJournal::beginRect(const TileRaft& raft, int raftIndex, int x0, int y0, int x1, int y1)
+{
+  endStroke();
+  x0 = max(x0, 0);
+  y0 = max(y0, 0);
+  x1 = min(x1, raft.width);
+  y1 = min(y1, raft.height);
+  if (x0 >= x1 || y0 >= y1)
+    return;
+
+  open = new Record;
+  open->kind = Record::RECT;
+  open->raft = raftIndex;
+  open->x0 = x0;
+  open->y0 = y0;
+  open->x1 = x1;
+  open->y1 = y1;
+  encodeRect(raft, x0, y0, x1, y1, open->before);
+}
+
+void UndoJournal::endRect(const TileRaft& raft)
+{
+  if (!open || open->kind != Record::RECT)
+    return;
+  encodeRect(raft, open->x0, open->y0, open->x1, open->y1, open->after);
+  /* A fill that changed nothing isn't worth an undo step */
+  if (open->after == open->before)
+    delete open;
+  else
+    push(open);
+  open = 0;
+}
+
+void UndoJournal::addRect(const TileRaft& raft, int raftIndex, int x0, int y0, int x1, int y1,
+                          const unsigned char *before)
+{
+  endStroke();
+  if (x0 < 0 || y0 < 0 || x1 > raft.width || y1 > raft.height || x0 >= x1 || y0 >= y1)
+    return;
+
+  open = new Record;
+  open->kind = Record::RECT;
+  open->raft = raftIndex;
+  open->x0 = x0;
+  open->y0 = y0;
+  open->x1 = x1;
+  open->y1 = y1;
+  RleEncoder rle(open->before);
+  for (int y = y0; y < y1; y++)
+    rle.put(before + (size_t)(y - y0) * (x1 - x0), x1 - x0);
+  rle.finish();
+  endRect(raft);
+}
+
+void UndoJournal::paint(const TileRaft& raft, int raftIndex, int x, int y, unsigned char tile)
+{
+  if (x < 0 || y < 0 || x >= raft.width || y >= raft.height)
+    return;
+
+  if (open && (open->kind != Record::STROKE || open->raft != raftIndex))
+    endStroke();
+  if (!open)
+  {
+    open = new Record;
+    open->kind = Record::STROKE;
+    open->raft = raftIndex;
+    strokeIndex.clear();
+  }
+
+  size_t pos = x + (size_t)y * raft.width;
+  map<size_t, size_t>::iterator i = strokeIndex.find(pos);
+  if (i != strokeIndex.end())
+  {
+    /* Painted earlier in this stroke: keep the original "before" */
+    open->after[i->second] = tile;
+    return;
+  }
+
+  unsigned char old = raft.get(x, y);
+  if (old == tile)
+    return;
+  strokeIndex[pos] = open->positions.size();
+  open->positions.push_back(pos);
+  open->before.push_back(old);
+  open->after.push_back(tile);
+}
+
+void UndoJournal::endStroke()
+{
+  if (!open || open->kind != Record::STROKE)
+    return;
+  if (open->positions.empty())
+    delete open;
+  else
+  {
+    /* The stroke is final now, don't pay for its growth slack */
+    vector<size_t>(open->positions).swap(open->positions);
+    vector<unsigned char>(open->before).swap(open->before);
+    vector<unsigned char>(open->after).swap(open->after);
+    push(open);
+  }
+  open = 0;
+  strokeIndex.clear();
+}
+
+void UndoJournal::apply(Record *r, vector<TileRaft*>& rafts, bool undo)
+{
+  if (r->raft < 0 || r->raft >= (int) rafts.size())
+    return;
+  TileRaft& raft = *rafts[r->raft];
+  const vector<unsigned char>& tiles = undo ? r->before : r->after;
+
+  if (r->kind == Record::RECT)
+  {
+    if (r->x1 <= raft.width && r->y1 <= raft.height)
+      decodeRect(raft, r->x0, r->y0, r->x1, r->y1, tiles);
+    return;
+  }
+
+  for (size_t i = 0; i < r->positions.size(); i++)
+  {
+    size_t pos = r->positions[i];
+    raft.set(pos % raft.width, pos / raft.width, tiles[i]);
+  }
+}
+
+bool UndoJournal::undo(vector<TileRaft*>& rafts)
+{
+  endStroke();
+  if (undoStack.empty())
+    return false;
+  Record *r = undoStack.back();
+  undoStack.pop_back();
+  apply(r, rafts, true);
+  redoStack.push_back(r);
+  return true;
+}
+
+bool UndoJournal::redo(vector<TileRaft*>& rafts)
+{
+  endStroke();
+  if (redoStack.empty())
+    return false;
+  Record *r = redoStack.back();
+  redoStack.pop_back();
+  apply(r, rafts, false);
+  undoStack.push_back(r);
+  return true;
+}
+
+void UndoJournal::push(Record *r)
+{
+  clearRedo();
+  undoStack.push_back(r);
+  bytes += r->size();
+  trim();
+}
+
+void UndoJournal::clearRedo()
+{
+  for (size_t i = 0; i < redoStack.size(); i++)
+  {
+    bytes -= redoStack[i]->size();
+    delete redoStack[i];
+  }
+  redoStack.clear();
+}
+
+void UndoJournal::trim()
+{
+  /* Always keep the latest step, even if it alone is over budget */
+  while (bytes > budget && undoStack.size() > 1)
+  {
+    bytes -= undoStack.front()->size();
+    delete undoStack.front();
+    undoStack.pop_front();
+  }
+}
+
+void UndoJournal::clear()
+{
+  delete open;
+  open = 0;
+  strokeIndex.clear();
+  clearRedo();
+  for (size_t i = 0; i < undoStack.size(); i++)
+    delete undoStack[i];
+  undoStack.clear();
+  bytes = 0;
+}
+
+void UndoJournal::setBudget(size_t budget_)
+{
+  budget = budget_;
+  trim();
+}
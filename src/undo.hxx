@@ -0,0 +1,90 @@
+#ifndef UNDO_HXX
+#define UNDO_HXX
+#include <stddef.h>
+#include <deque>
+#include <map>
+#include <vector>
+
+struct TileRaft;
+
+/* Undo/redo journal for map edits
+ *
+ * Edits are stored as deltas rather than snapshots, in one of two forms:
+ *
+ *  - rectangle records, for fills: the contents of the affected rectangle
+ *    before and after the edit, each run-length encoded, so that a fill costs
+ *    a few bytes for the "after" side and only as much as the old contents
+ *    take to encode for the "before" side.
+ *  - stroke records, for painting: the position and old and new tile of each
+ *    tile painted during one drag, with repeat visits to a tile coalesced.
+ *
+ * Undoing or redoing a record costs time proportional to the tiles it
+ * changed. Once the journal grows past its memory budget the oldest records
+ * are forgotten.
+ *
+ * Records refer to rafts by their index in the World, so the journal must be
+ * cleared whenever the World's rafts are replaced.
+ */
+struct UndoJournal {
+  size_t budget;
+  size_t bytes;
+
+  UndoJournal();
+  ~UndoJournal();
+
+  /* Call before and after filling [x0,x1) x [y0,y1) of a raft */
+  void beginRect(const TileRaft& raft, int raftIndex, int x0, int y0, int x1, int y1);
+  void endRect(const TileRaft& raft);
+  /* Or, once [x0,x1) x [y0,y1) has been changed, given what it held before,
+   * row by row. The rectangle must lie within the raft. */
+  void addRect(const TileRaft& raft, int raftIndex, int x0, int y0, int x1, int y1,
+               const unsigned char *before);
+
+  /* Call before painting tile (x, y); consecutive calls until endStroke()
+   * form a single undo step */
+  void paint(const TileRaft& raft, int raftIndex, int x, int y, unsigned char tile);
+  void endStroke();
+
+  /* Undo or redo the most recent step on rafts. Returns false if there was
+   * nothing to undo or redo. */
+  bool undo(std::vector<TileRaft*>& rafts);
+  bool redo(std::vector<TileRaft*>& rafts);
+
+  void clear();
+  void setBudget(size_t budget);
+
+  size_t undoSteps() const { return undoStack.size(); }
+  size_t redoSteps() const { return redoStack.size(); }
+
+private:
+  struct Record {
+    enum { RECT, STROKE } kind;
+    int raft;
+    /* RECT: the rectangle and its encoded contents */
+    int x0, y0, x1, y1;
+    std::vector<unsigned char> before;
+    std::vector<unsigned char> after;
+    /* STROKE: tile positions (x + y*width, which can pass 2^32 on a big
+     * raft) with their old and new tiles; before and after hold the tiles */
+    std::vector<size_t> positions;
+
+    size_t size() const;
+  };
+
+  std::deque<Record*> undoStack;
+  std::vector<Record*> redoStack;
+
+  /* The record being built by beginRect() or paint() */
+  Record *open;
+  /* Index into open->positions of each position painted in this stroke */
+  std::map<size_t, size_t> strokeIndex;
+
+  void push(Record *r);
+  void clearRedo();
+  void trim();
+  static void apply(Record *r, std::vector<TileRaft*>& rafts, bool undo);
+
+  UndoJournal(const UndoJournal &);
+  UndoJournal & operator=(const UndoJournal &);
+};
+#endif
@@ -0,0 +1,197 @@
+#ifndef WORLD_HXX
+#define WORLD_HXX
+#include "tile-raft.hxx"
+#include "mapfile.hxx"
+#include "raft-grid.hxx"
+#include "undo.hxx"
+#include "arena.hxx"
+#include "collision.hxx"
+#include "camera.hxx"
+#include "pathfind.hxx"
+#include "region.hxx"
+#include <math.h>
+#include <stdint.h>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/* The game state, shared by interactive-application.cxx, which plays it,
+ * and benchmarks.cxx, which times it */
+
+/* Interpolation factor between the last step and the next for the frame being
+ * drawn (see Game :: Draw()) */
+extern double stepAlpha;
+
+/* Tiles sent to the GL and culled, overview quads drawn, and the level of
+ * detail, during the last World :: draw() */
+extern int tilesSubmitted;
+extern int tilesSkipped;
+extern int overviewsSubmitted;
+extern int lastLod;
+
+struct World {
+  std::vector<TileRaft*> rafts;
+
+  /* Rafts loaded from map files, and their chunks and tiles, are allocated
+   * from the arena (unless useArena is cleared, for benchmarking), so that
+   * clear() can throw them all away at once */
+  Arena arena;
+  bool useArena;
+
+  /* Each raft's position and size in world pixels, as parallel arrays
+   * indexed like rafts, kept by addRaft() and moveRaft() */
+  std::vector<int> raftX;
+  std::vector<int> raftY;
+  std::vector<int> raftW;
+  std::vector<int> raftH;
+
+  /* Each raft's velocity, in pixels per step, and its position before the
+   * last step, which draw() interpolates from */
+  std::vector<int> raftVX;
+  std::vector<int> raftVY;
+  std::vector<int> raftPrevX;
+  std::vector<int> raftPrevY;
+  /* The furthest any raft moved on either axis in the last step, and so the
+   * furthest a raft can be drawn from where it is */
+  int maxMove;
+
+  /* Collision detection state; see step() */
+  SweepAndPrune sweep;
+  std::vector<SolidMask> masks;
+  std::vector<std::pair<int, int> > contacts;
+  /* The contacts worth testing, their results, and the rafts they need
+   * masks for */
+  std::vector<std::pair<int, int> > tests;
+  std::vector<char> hits;
+  std::vector<char> needMask;
+  std::vector<int> maskRafts;
+  std::vector<bool> bounced;
+  /* Broad phase pairs and actual collisions found by the last step() */
+  int lastPairs;
+  int lastCollisions;
+
+  /* The binary map file the rafts were loaded from, if any. The rafts may
+   * read their tiles straight out of it, so it lives as long as the World. */
+  MapFile *mapFile;
+
+  /* Index of the rafts' bounding boxes. Rafts must be added with addRaft()
+   * and moved with moveRaft() to keep it up to date. */
+  RaftGrid grid;
+  int totalTiles;
+
+  /* Navigation grids for pathfinding, indexed like rafts and brought up
+   * to date by navGrid() */
+  std::vector<NavGrid> navs;
+
+  /* Edits made to the rafts, for undo/redo */
+  UndoJournal journal;
+
+  /* The view onto the world, and the screen position the mouse was last
+   * seen at, which dragging with the middle button pans from */
+  Camera camera;
+  int mouseX;
+  int mouseY;
+  bool panning;
+
+  /* edit-mode stuff */
+  bool editMode;
+  /* current tile pos and TileRaft selected by edit cursor */
+  int cursorRaft;
+  int cursorX;
+  int cursorY;
+  static int pickedTile;
+  bool cursorPainting;
+
+  World()
+  {
+    mapFile = NULL;
+    useArena = true;
+    lastPairs = 0;
+    lastCollisions = 0;
+    maxMove = 0;
+    totalTiles = 0;
+    mouseX = 0;
+    mouseY = 0;
+    panning = false;
+    editMode = true;
+    cursorX = -1;
+    cursorY = -1;
+    cursorRaft = -1;
+    cursorPainting = false;
+  }
+
+  ~World();
+
+  /* Remove every raft. The arena is rewound, not freed, so that the next
+   * load can reuse its memory. */
+  void clear();
+
+  /* Add the rafts of a text map, or of a binary map file, which the World
+   * then owns */
+  void load(std::istream& in);
+  void load(MapFile *file);
+
+  void addRaft(TileRaft *raft);
+  void moveRaft(int i, int xOff, int yOff);
+
+  /* Indices of the rafts at a point, or overlapping a rectangle, in world
+   * pixels (i.e. not including the scroll offset), in ascending order */
+  void raftsAt(int x, int y, std::vector<int>& out);
+  void raftsIn(int x0, int y0, int x1, int y1, std::vector<int>& out);
+  /* The same as raftsAt(), for where the rafts are drawn (see drawX()) */
+  void raftsDrawnAt(int x, int y, std::vector<int>& out);
+
+  /* Move every raft by its velocity. Rafts whose solid tiles would then
+   * overlap and that were heading into each other go back where they were
+   * and bounce off the sides that met. */
+  void step();
+
+  /* Where raft i is drawn, between its last two positions */
+  int drawX(int i) const
+  {
+    return raftPrevX[i] + (int)floor((raftX[i] - raftPrevX[i]) * stepAlpha + 0.5);
+  }
+  int drawY(int i) const
+  {
+    return raftPrevY[i] + (int)floor((raftY[i] - raftPrevY[i]) * stepAlpha + 0.5);
+  }
+
+  /* Draw the world as seen from (vx, vy) at vzoom, as Camera :: view()
+   * gives it */
+  void draw(double vx, double vy, double vzoom);
+  /* Raft i's navigation grid, updated for any edits since it was last used */
+  const NavGrid& navGrid(int i)
+  {
+    navs[i].update(*rafts[i]);
+    return navs[i];
+  }
+  /* mapChecksum() of everything input can change: the rafts' tiles,
+   * positions and velocities, the camera and the edit cursor */
+  uint32_t checksum(uint32_t adler) const;
+  bool mouse(int x, int y);
+  bool mouseButton(int button, bool down);
+  bool key(int key, bool down);
+  bool validateCursor();
+  /* regionBucketFill() raft i from tile (x, y), journaling just the
+   * rectangle it changed as one undo step */
+  size_t bucketFill(int i, int x, int y, unsigned char tile, bool diagonal, BucketStack& stack);
+
+  friend std::ostream & operator<<(std::ostream &out, const World &);
+};
+
+namespace Game
+{
+    /* The world being played, a scratch raft to pick tiles from, and
+     * whichever of the two input goes to */
+    extern World *gameWorld;
+    extern World *scratchWorld;
+    extern World *activeWorld;
+
+    /* The path of the map called filename under data/maps */
+    std::string mapFilename(std::string filename);
+    /* Clear "into" and load a map file of either format into it, returning
+     * false on failure */
+    bool loadWorld(std::string filename, World *into);
+};
+#endif